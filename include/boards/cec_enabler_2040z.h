@@ -46,6 +46,10 @@
 #define PICO_DEFAULT_I2C_SCL_PIN 5
 #endif
 
+// --- HDMI ---
+// Hot-plug detect (HDMI pin 19, 5V so divide it down) is not wired on this
+// board, build with -DHDMI_HPD_PIN=7 once a divider is fitted
+
 // --- SPI ---
 #ifndef PICO_DEFAULT_SPI
 #define PICO_DEFAULT_SPI 1
@@ -0,0 +1,58 @@
+#ifndef CEC_CAPTURE_H
+#define CEC_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Edge capture of the CEC line.
+ *
+ * Edges are stored in self-contained blocks. Each block starts with the time
+ * of its first edge (8 bytes, little endian, microseconds since boot),
+ * followed by one unsigned LEB128 varint per edge:
+ *
+ *   (microseconds since the previous edge << 1) | level after the edge
+ *
+ * The first edge of a block has a delta of 0. CEC levels last 400 us to
+ * 4.5 ms, so most edges take two bytes.
+ */
+#define CEC_CAPTURE_BLOCK_SIZE (248)
+#define CEC_CAPTURE_BLOCKS (32)
+
+typedef enum {
+  CEC_CAPTURE_IDLE = 0,
+  CEC_CAPTURE_RUNNING = 1,    // recording, stops when the buffer is full
+  CEC_CAPTURE_ARMED = 2,      // recording into a ring, waiting for an abort
+  CEC_CAPTURE_TRIGGERED = 3,  // abort seen, recording the post-trigger window
+  CEC_CAPTURE_DONE = 4,
+} cec_capture_state_t;
+
+/* Set while edges are being recorded. */
+extern volatile bool cec_capture_active;
+
+/**
+ * Start a capture.
+ *
+ * With on_abort, the buffer is a ring holding the edges before the first
+ * receive abort, and capture stops CEC_CAPTURE_POST_MS after it. Otherwise
+ * capture stops once the buffer is full.
+ */
+void cec_capture_start(bool on_abort);
+void cec_capture_stop(void);
+cec_capture_state_t cec_capture_get_state(void);
+
+/** Record an edge, called from interrupt context with time_us_32(). */
+void cec_capture_edge(uint32_t now, bool level);
+
+/** A receive abort, called from interrupt context with time_us_32(). */
+void cec_capture_trigger(uint32_t now);
+
+/**
+ * Get a block of a finished capture, oldest first.
+ *
+ * Returns false once n is past the last block.
+ */
+bool cec_capture_get_block(unsigned int n, const uint8_t **data, size_t *len);
+
+#endif
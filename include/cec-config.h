@@ -24,11 +24,67 @@ typedef enum {
   CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM = 5,
 } cec_config_device_type_t;
 
+/** Longest OSD name, in characters. */
+#define CEC_CONFIG_OSD_NAME_LEN 14
+
+/**
+ * Receive timing window presets.
+ */
+typedef enum {
+  CEC_CONFIG_TIMING_CUSTOM = 0,
+  CEC_CONFIG_TIMING_STRICT = 1,   // the windows from the HDMI CEC specification
+  CEC_CONFIG_TIMING_RELAXED = 2,  // wider windows for sinks with drifting clocks
+} cec_config_timing_t;
+
+/*
+ * Pulses shorter than this are noise to the receiver, the pulse and its edges
+ * are ignored. Every receive window starts above it.
+ */
+#define CEC_RX_GLITCH_US (100)
+
+/** Receive acceptance window, in microseconds. */
+typedef struct {
+  uint16_t min;
+  uint16_t max;
+} cec_config_window_t;
+
+/**
+ * Receive acceptance windows, a measurement outside its window aborts the
+ * frame.
+ */
+typedef struct {
+  /** Start bit low time. */
+  cec_config_window_t start_low;
+
+  /** Start bit period, falling edge to falling edge. */
+  cec_config_window_t start_period;
+
+  /** Low time of a logical 1 (and of an ACK bit not asserted). */
+  cec_config_window_t one_low;
+
+  /** Low time of a logical 0 (and of an asserted ACK bit). */
+  cec_config_window_t zero_low;
+
+  /** Data bit period, falling edge to falling edge. */
+  cec_config_window_t bit_period;
+} cec_config_rx_timing_t;
+
+/**
+ * Receive window shifts learnt from one initiator, in microseconds.
+ */
+typedef struct {
+  int16_t start_low;
+  int16_t start_period;
+  int16_t bit_period;
+  int16_t one_low;
+  int16_t zero_low;
+} cec_config_rx_offset_t;
+
 /**
  * CEC configuration in-memory.
  */
 typedef struct {
-  /** DDC EDID delay in milliseconds. */
+  /** Maximum wait for the DDC EDID at boot, in milliseconds. */
   uint32_t edid_delay_ms;
 
   /** CEC physical address. */
@@ -37,14 +93,41 @@ typedef struct {
   /** CEC logical address. */
   uint8_t logical_address;
 
+  /**
+   * Last allocated logical addresses, a bit per address, polled first on the
+   * next allocation.
+   */
+  uint16_t last_logical_addresses;
+
   /** CEC device type. */
   uint8_t device_type;
 
+  /**
+   * Device types claimed besides device_type, a bit per
+   * cec_config_device_type_t, each allocating its own logical address.
+   */
+  uint8_t extra_device_types;
+
   /** Keymap configuration. */
   cec_config_keymap_t keymap_type;
 
   /** User Control key mapping table. */
   command_t keymap[UINT8_MAX];
+
+  /** Receive timing preset. */
+  cec_config_timing_t rx_timing_type;
+
+  /** Receive acceptance windows, only read from NVS for the custom preset. */
+  cec_config_rx_timing_t rx_timing;
+
+  /** Receive window shifts per initiator logical address. */
+  cec_config_rx_offset_t rx_offset[16];
+
+  /** OSD name, NUL terminated. */
+  char osd_name[CEC_CONFIG_OSD_NAME_LEN + 1];
+
+  /** IEEE OUI reported as the vendor ID. */
+  uint32_t vendor_id;
 } cec_config_t;
 
 /**
@@ -95,7 +178,11 @@ typedef enum {
 /** Mapping from CEC user code to human readable string. */
 extern const char *cec_user_control_name[UINT8_MAX];
 
+/** Receive windows required by the specification, the strict preset. */
+extern const cec_config_rx_timing_t cec_config_spec_rx_timing;
+
 void cec_config_set_keymap(cec_config_t *config);
+void cec_config_set_rx_timing(cec_config_t *config);
 void cec_config_set_default(cec_config_t *config);
 
 void cec_config_complete(cec_config_t *config);
@@ -1,11 +1,105 @@
 #ifndef CEC_LOG_H
 #define CEC_LOG_H
 
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Log levels, calls above CEC_LOG_LEVEL are compiled out. */
+#define CEC_LOG_LEVEL_ERROR (0)
+#define CEC_LOG_LEVEL_WARN (1)
+#define CEC_LOG_LEVEL_INFO (2)
+#define CEC_LOG_LEVEL_DEBUG (3)
+
+#ifndef CEC_LOG_LEVEL
+#define CEC_LOG_LEVEL CEC_LOG_LEVEL_INFO
+#endif
+
+/* Log categories, selected at runtime with cec_log_set_mask(). */
+typedef enum {
+  CEC_LOG_PHY = 0x01,    // bit timing, aborts and arbitration
+  CEC_LOG_PROTO = 0x02,  // frames and logical addressing
+  CEC_LOG_DDC = 0x04,    // EDID reads and parsing
+  CEC_LOG_NVS = 0x08,    // configuration storage
+  CEC_LOG_USB = 0x10,    // USB host events
+  CEC_LOG_ALL = 0x1f
+} cec_log_category_t;
+
+/**
+ * Categories being logged, 0 while logging is disabled.
+ *
+ * Read by the log macros before any arguments are evaluated.
+ */
+extern volatile uint32_t cec_log_active;
+
+/* True if a message of this level and category would be logged. */
+#define CEC_LOG_ON(level, category) \
+  (((level) <= CEC_LOG_LEVEL) && ((cec_log_active & (category)) != 0))
+
+#define CEC_LOG(level, category, ...)  \
+  do {                                 \
+    if (CEC_LOG_ON(level, category)) { \
+      cec_log_submitf(__VA_ARGS__);    \
+    }                                  \
+  } while (0)
+
+#define CEC_LOG_ERROR(category, ...) CEC_LOG(CEC_LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#define CEC_LOG_WARN(category, ...) CEC_LOG(CEC_LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define CEC_LOG_INFO(category, ...) CEC_LOG(CEC_LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define CEC_LOG_DEBUG(category, ...) CEC_LOG(CEC_LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+
+/* Frame record flags. */
+#define CEC_LOG_FRAME_RECV (0x01)
+#define CEC_LOG_FRAME_ACK (0x02)
+
+/**
+ * Binary record of a CEC frame, copied in the hot path and formatted later
+ * by the log task.
+ */
+typedef struct {
+  uint64_t timestamp;  // start bit, microseconds since boot
+  uint8_t flags;       // CEC_LOG_FRAME_*
+  uint8_t len;
+  uint8_t data[16];
+} cec_log_frame_t;
+
+/* Frame record producers, each task has its own ring. */
+typedef enum {
+  CEC_LOG_RING_RX = 0,
+  CEC_LOG_RING_TX = 1,
+  CEC_LOG_RING_COUNT = 2
+} cec_log_ring_t;
+
+/* Format a frame record into a line, called from the log task. */
+typedef void (*cec_log_format_t)(const cec_log_frame_t *record, char *buf, size_t size);
+
 void cec_log_init(void);
 bool cec_log_enabled();
 void cec_log_enable(void);
 void cec_log_disable(void);
+
+/** Set the categories logged while logging is enabled, all by default. */
+void cec_log_set_mask(uint32_t mask);
+uint32_t cec_log_get_mask(void);
+
 void cec_log_vsubmitf(const char *fmt, va_list ap);
 __attribute__((format(printf, 1, 2))) void cec_log_submitf(const char *fmt, ...);
 
+/**
+ * Log a frame without formatting it.
+ *
+ * Each ring has a single producer, so only one task may use it. Callers
+ * check CEC_LOG_ON() first, records are dropped and counted when the ring is
+ * full.
+ */
+void cec_log_frame(cec_log_ring_t ring,
+                   uint64_t timestamp,
+                   const uint8_t *data,
+                   uint8_t len,
+                   uint8_t flags);
+
+/** Set the function used to format frame records. */
+void cec_log_set_format(cec_log_format_t format);
+
 #endif
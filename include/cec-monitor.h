@@ -0,0 +1,71 @@
+#ifndef CEC_MONITOR_H
+#define CEC_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Bus monitor trace stream.
+ *
+ * Every record is framed, all fields are little endian:
+ *   sync    2 bytes, CEC_TRACE_SYNC0 CEC_TRACE_SYNC1
+ *   type    1 byte, cec_trace_type_t
+ *   length  1 byte, payload length
+ *   payload length bytes
+ *   crc     4 bytes, CRC-32 of type, length and payload
+ *
+ * Payloads:
+ *   HEADER  version (1)
+ *   FRAME   timestamp (8, start bit in microseconds since boot),
+ *           duration (4, microseconds to the final ACK or abort),
+ *           flags (1, CEC_TRACE_FLAG_*), abort (1, hdmi_frame_abort_t),
+ *           frame blocks (0 to 16)
+ *   DROP    frames dropped since the monitor started (4)
+ *   EDGES   one block of a finished edge capture, see cec-capture.h
+ */
+#define CEC_TRACE_SYNC0 (0xce)
+#define CEC_TRACE_SYNC1 (0xc3)
+#define CEC_TRACE_VERSION (1)
+
+typedef enum {
+  CEC_TRACE_HEADER = 0x01,
+  CEC_TRACE_FRAME = 0x02,
+  CEC_TRACE_DROP = 0x03,
+  CEC_TRACE_EDGES = 0x04,
+} cec_trace_type_t;
+
+/* Frame record flags. */
+#define CEC_TRACE_FLAG_ACK (0x01)  // every block ACKed (line held low)
+#define CEC_TRACE_FLAG_EOM (0x02)  // frame ended with EOM
+#define CEC_TRACE_FLAG_TX (0x04)   // sent by us
+
+/**
+ * Claim the monitor UART and create the monitor task, capture starts
+ * straight away. Only called when built with CEC_MONITOR.
+ *
+ * An edge capture is also armed to trigger on the next receive abort, it is
+ * streamed once complete and then re-armed.
+ */
+void cec_monitor_init(void);
+
+void cec_monitor_start(void);
+void cec_monitor_stop(void);
+
+/* Set while capturing, tested before calling cec_monitor_capture(). */
+extern volatile bool cec_monitor_active;
+
+/**
+ * Capture a frame, called from the receive interrupt for every frame on the
+ * bus. The frame is dropped and counted if the ring is full.
+ */
+void cec_monitor_capture(uint64_t start,
+                         uint64_t end,
+                         const uint8_t *data,
+                         uint8_t len,
+                         uint8_t flags,
+                         uint8_t abort);
+
+/* Frames captured and dropped since the monitor started. */
+void cec_monitor_get_counts(uint32_t *captured, uint32_t *dropped);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CEC_PROFILE_H
+#define CEC_PROFILE_H
+
+#include <stdint.h>
+
+#include "hardware/structs/systick.h"
+
+/*
+ * Interrupt and timer callback execution time, in CPU (clk_sys) cycles.
+ *
+ * Handlers are timed from entry to exit with the SysTick counter, which the
+ * RTOS runs from the CPU clock. A handler preempted by a higher priority
+ * interrupt includes that interrupt's time.
+ */
+
+/* Profiled handlers. */
+typedef enum {
+  CEC_PROFILE_RX = 0,           // receive interrupt, GPIO edge or PIO block
+  CEC_PROFILE_TX = 1,           // transmit alarm callback, or PIO arbitration interrupt
+  CEC_PROFILE_ACK_RELEASE = 2,  // receive ACK release alarm (GPIO)
+  CEC_PROFILE_ACK_DRIVE = 3,    // receive interrupt entry to ACK pull-down (GPIO)
+  CEC_PROFILE_USB_HOST = 4,     // USB host controller interrupt
+  CEC_PROFILE_TX_DMA = 5,       // transmit DMA completion interrupt (PIO)
+  CEC_PROFILE_COUNT = 6
+} cec_profile_point_t;
+
+/*
+ * Histogram buckets, doubling in width: bucket 0 counts under 32 cycles,
+ * bucket n counts 2^(n + 4) to 2^(n + 5) - 1 and the last bucket everything
+ * above.
+ */
+#define CEC_PROFILE_BUCKETS 16
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t mean;
+  uint32_t max;
+  uint32_t hist[CEC_PROFILE_BUCKETS];
+} cec_profile_stats_t;
+
+/* Start timing a handler, pass the result to cec_profile_end(). */
+static inline uint32_t cec_profile_begin(void) {
+  return systick_hw->cvr;
+}
+
+/** Finish timing a handler, called from interrupt context. */
+void cec_profile_end(cec_profile_point_t point, uint32_t begin);
+
+/**
+ * Time the USB host controller interrupt, called once tusb_init() has added
+ * the controller's shared handler.
+ */
+void cec_profile_usb_init(void);
+
+void cec_profile_get(cec_profile_point_t point, cec_profile_stats_t *stats);
+void cec_profile_reset(void);
+
+#endif
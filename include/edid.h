@@ -0,0 +1,72 @@
+#ifndef EDID_H
+#define EDID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EDID_BLOCK_SIZE (128)
+#define EDID_HEADER_SIZE (8)
+#define EDID_EXTENSIONS (126)
+#define EDID_CHECKSUM (127)
+
+/* Extension block tags. */
+#define EDID_TAG_CTA (0x02)
+#define EDID_TAG_DISPLAYID (0x70)
+#define EDID_TAG_BLOCK_MAP (0xf0)
+
+/* CTA data block tags. */
+#define EDID_CTA_TAG_VENDOR (0x03)
+#define EDID_CTA_TAG_EXTENDED (0x07)
+
+/**
+ * Read one 128 byte EDID block, returns 0 on success.
+ *
+ * The reader is expected to verify the block checksum.
+ */
+typedef int (*edid_read_block_t)(uint8_t block, uint8_t *data, void *ctx);
+
+/* A CTA data block, the payload points into the EDID block. */
+typedef struct {
+  uint8_t tag;
+  uint8_t len;
+  const uint8_t *payload;
+} edid_cta_db_t;
+
+/* Iterator over the CTA data blocks of a block, parsed in place. */
+typedef struct {
+  const uint8_t *next;
+  const uint8_t *end;
+} edid_cta_iter_t;
+
+/** Check the EDID block 0 header. */
+bool edid_header_valid(const uint8_t *block);
+
+/** Check the block checksum. */
+bool edid_block_valid(const uint8_t *block);
+
+/** Iterate over the data block collection of a CTA extension block. */
+void edid_cta_iter_init(edid_cta_iter_t *it, const uint8_t *block);
+
+/** Iterate over CTA data blocks embedded elsewhere (e.g. DisplayID). */
+void edid_cta_iter_init_range(edid_cta_iter_t *it, const uint8_t *data, size_t len);
+
+/** Get the next data block, returns false at the end or on a truncated block. */
+bool edid_cta_iter_next(edid_cta_iter_t *it, edid_cta_db_t *db);
+
+/**
+ * Find the CEC physical address in the HDMI vendor specific data block.
+ *
+ * Block 0 is read first, then only the extensions that can hold CTA data
+ * blocks, as named by a block map if there is one. The search stops at the
+ * first HDMI VSDB. block is set to the block holding it.
+ *
+ * Returns false if a block could not be read. address is 0x0000 if the EDID
+ * has no HDMI VSDB.
+ */
+bool edid_find_physical_address(edid_read_block_t read,
+                                void *ctx,
+                                uint16_t *address,
+                                uint8_t *block);
+
+#endif
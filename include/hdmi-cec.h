@@ -7,6 +7,7 @@
 
 #include "task.h"
 #define CEC_TASK_NAME "cec"
+#define CEC_TX_TASK_NAME "cec_tx"
 
 #ifndef CEC_PIN
 #define CEC_PIN 3  // GPIO3 == D10 (Seeed Studio XIAO RP2040)
@@ -29,19 +30,38 @@ typedef enum {
   HDMI_FRAME_STATE_ACK_WAIT = 8,
   HDMI_FRAME_STATE_ACK_END = 9,
   HDMI_FRAME_STATE_END = 10,
-  HDMI_FRAME_STATE_ABORT = 11
+  HDMI_FRAME_STATE_ABORT = 11,
+  HDMI_FRAME_STATE_ARBITRATE = 12,
+  HDMI_FRAME_STATE_GLITCH = 13  // short pulse, waiting for its other edge
 } hdmi_frame_state_t;
 
+/* Reason a frame was aborted. */
+typedef enum {
+  HDMI_FRAME_ABORT_NONE = 0,
+  HDMI_FRAME_ABORT_START = 1,        // start bit low time out of range
+  HDMI_FRAME_ABORT_BIT_PERIOD = 2,   // data bit period out of range
+  HDMI_FRAME_ABORT_BIT_LOW = 3,      // data bit low time out of range
+  HDMI_FRAME_ABORT_ACK = 4,          // ACK bit low time out of range
+  HDMI_FRAME_ABORT_OVERFLOW = 5,     // more than 16 blocks
+  HDMI_FRAME_ABORT_RESYNC = 6,       // new start bit before the frame ended
+  HDMI_FRAME_ABORT_ARBITRATION = 7,  // lost arbitration in the initiator address
+  HDMI_FRAME_ABORT_BUSY = 8,         // line already low at the start bit
+} hdmi_frame_abort_t;
+
 typedef struct {
   hdmi_message_t *message;
   unsigned int bit;
   unsigned int byte;
   uint64_t start;
+  uint64_t timestamp;  // start bit falling edge
+  uint64_t end;        // end of the frame (final ACK)
   bool first;
   bool eom;
   bool ack;
-  uint8_t address;
+  bool loopback;  // received while transmitting
+  uint16_t addresses;  // logical addresses to ACK, a bit per address
   hdmi_frame_state_t state;
+  hdmi_frame_abort_t abort;
 } hdmi_frame_t;
 
 /* @todo need atomics for thread sync safety */
@@ -50,14 +70,146 @@ typedef struct {
   uint32_t tx_frames;
   uint32_t rx_abort_frames;
   uint32_t tx_noack_frames;
+  uint32_t tx_arb_lost_frames;
+  uint32_t tx_arb_busy_frames;
+  uint32_t tx_retransmit_frames;
+  uint32_t tx_queue_full;
+  uint32_t rx_dropped_frames;
 } hdmi_cec_stats_t;
 
+/* Reply latency histogram buckets, see cec_latency_bucket_ms for bounds. */
+#define CEC_LATENCY_BUCKETS 10
+
+/* Number of request opcodes tracked for reply latency. */
+#define CEC_LATENCY_OPCODES 8
+
+/* Reply latency for one request opcode, in microseconds. */
+typedef struct {
+  uint8_t opcode;
+  uint32_t count;
+  uint32_t start_max_us;
+  uint32_t ack_max_us;
+  uint32_t start[CEC_LATENCY_BUCKETS];  // request end to reply start bit
+  uint32_t ack[CEC_LATENCY_BUCKETS];    // request end to reply ACK
+} cec_latency_hist_t;
+
+typedef struct {
+  cec_latency_hist_t opcode[CEC_LATENCY_OPCODES];
+  uint32_t dropped;  // replies to opcodes beyond CEC_LATENCY_OPCODES
+} cec_latency_stats_t;
+
+extern const uint16_t cec_latency_bucket_ms[CEC_LATENCY_BUCKETS];
+
+/* Frame counters for one opcode. */
+typedef struct {
+  uint32_t rx;              // received, for any destination
+  uint32_t tx;              // sent
+  uint32_t rejected;        // for us, but too short or wrongly addressed
+  uint32_t handled;         // passed to the handler
+  uint32_t handler_us;      // total time spent in the handler
+  uint32_t handler_max_us;  // longest time spent in the handler
+} cec_opcode_stats_t;
+
+/* Receive timing measurements, each with a histogram. */
+typedef enum {
+  CEC_RX_MEASURE_START_LOW = 0,
+  CEC_RX_MEASURE_START_PERIOD = 1,
+  CEC_RX_MEASURE_BIT_LOW = 2,
+  CEC_RX_MEASURE_BIT_PERIOD = 3,
+  CEC_RX_MEASURE_ACK_LOW = 4,
+  CEC_RX_MEASURE_COUNT = 5
+} cec_rx_measure_t;
+
+/* Bound of the acceptance window a measurement failed. */
+typedef enum {
+  CEC_RX_BOUND_SHORT = 0,  // below the minimum
+  CEC_RX_BOUND_LONG = 1,   // above the maximum
+  CEC_RX_BOUND_GAP = 2,    // between the logical 1 and 0 low time windows
+  CEC_RX_BOUND_COUNT = 3
+} cec_rx_bound_t;
+
+/*
+ * Receive timing histogram buckets, CEC_RX_HIST_US wide from
+ * cec_rx_hist_base_us. The first and last buckets also count everything
+ * below and above.
+ */
+#define CEC_RX_HIST_BUCKETS 16
+#define CEC_RX_HIST_US 100
+
+typedef struct {
+  uint32_t hist[CEC_RX_MEASURE_COUNT][CEC_RX_HIST_BUCKETS];
+  uint32_t abort[CEC_RX_MEASURE_COUNT][CEC_RX_BOUND_COUNT];
+  uint32_t glitches;  // pulses filtered out as noise
+  uint32_t resyncs;   // frames received from a start bit found after an abort
+} cec_rx_timing_stats_t;
+
+/* Bit timing learnt from one initiator, in microseconds. */
+typedef struct {
+  uint32_t frames;  // start bits measured, older frames decay
+  uint32_t bits;    // data bits measured, older bits decay
+  uint16_t start_low_mean;
+  uint16_t start_low_stddev;
+  uint16_t start_period_mean;
+  uint16_t start_period_stddev;
+  uint16_t bit_period_mean;
+  uint16_t bit_period_stddev;
+  uint16_t one_low_mean;
+  uint16_t one_low_stddev;
+  uint16_t zero_low_mean;
+  uint16_t zero_low_stddev;
+  int16_t start_low_offset;  // receive window shifts applied
+  int16_t start_period_offset;
+  int16_t bit_period_offset;
+  int16_t one_low_offset;
+  int16_t zero_low_offset;
+} cec_rx_peer_stats_t;
+
+extern const uint16_t cec_rx_hist_base_us[CEC_RX_MEASURE_COUNT];
+
+/* Transmit queue priority, higher priority queues are always emptied first. */
+typedef enum {
+  CEC_TX_PRIORITY_REPLY = 0,
+  CEC_TX_PRIORITY_BROADCAST = 1,
+  CEC_TX_PRIORITY_POLL = 2,
+  CEC_TX_PRIORITY_COUNT = 3
+} cec_tx_priority_t;
+
+/* Outcome of a transmission. */
+typedef enum {
+  CEC_TX_ACKED = 0,
+  CEC_TX_NACKED = 1,    // sent, nobody acknowledged it
+  CEC_TX_NOT_SENT = 2,  // queue full or arbitration lost on every attempt
+} cec_tx_result_t;
+
+/* Called from the transmit task once a queued frame has been sent. */
+typedef void (*cec_tx_done_t)(cec_tx_result_t result, void *ctx);
+
 extern TaskHandle_t xCECTask;
 
 uint64_t cec_get_uptime_ms(void);
 void cec_get_stats(hdmi_cec_stats_t *stats);
+void cec_get_latency_stats(cec_latency_stats_t *stats);
+void cec_reset_latency_stats(void);
+void cec_get_opcode_stats(uint8_t opcode, cec_opcode_stats_t *stats);
+const char *cec_get_opcode_name(uint8_t opcode);
+void cec_get_rx_timing_stats(cec_rx_timing_stats_t *stats);
+void cec_reset_rx_timing_stats(void);
+void cec_get_rx_peer_stats(uint8_t initiator, cec_rx_peer_stats_t *stats);
 uint16_t cec_get_physical_address(void);
 uint8_t cec_get_logical_address(void);
+uint16_t cec_get_logical_addresses(void);
 void cec_task(void *data);
 
+/**
+ * Queue a frame for transmission without blocking.
+ *
+ * The frame is copied, done (may be NULL) is called with the outcome once the
+ * transmit task is finished with it. Returns false if the frame is invalid or the queue is full.
+ */
+bool cec_send_async(const uint8_t *data,
+                    uint8_t len,
+                    cec_tx_priority_t priority,
+                    cec_tx_done_t done,
+                    void *ctx);
+
 #endif
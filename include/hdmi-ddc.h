@@ -2,8 +2,66 @@
 #define HDMI_DDC_H
 
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-uint16_t ddc_get_physical_address(void);
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* EDID cache statistics. */
+typedef struct {
+  uint32_t hits;     // answered from the cache, including revalidations
+  uint32_t checks;   // revalidated by reading the header and checksums only
+  uint32_t misses;   // full EDID reads
+  uint32_t changes;  // full reads that returned a different EDID
+  uint32_t read_us;   // DDC transfer time of the last full read
+  uint32_t parse_us;  // parse time of the last full read, excluding transfers
+} ddc_cache_stats_t;
+
+/**
+ * Create the DDC task, which owns the DDC bus.
+ *
+ * The task first waits up to ready_timeout_ms for the sink to answer with a
+ * valid EDID header (and for hot-plug detect, if it is wired).
+ *
+ * In builds with PICO_DEFAULT_HDMI_HPD_PIN (the HDMI_HPD_PIN option),
+ * hotplug_task is given a notification at hotplug_index once per debounced
+ * plug event.
+ */
+void ddc_task_init(uint32_t ready_timeout_ms, TaskHandle_t hotplug_task, UBaseType_t hotplug_index);
+
+/**
+ * Take a pending plug event, returns false if there is none.
+ */
+bool ddc_take_hotplug(void);
+
+/**
+ * Get the time since boot the EDID became readable, 0 if not (yet) ready.
+ */
+uint32_t ddc_get_ready_ms(void);
+
+/**
+ * Ask the DDC task for the physical address from the EDID.
+ *
+ * The parsed EDID is cached and only read again after ddc_refresh(). task is
+ * given a notification at index once the result can be taken with
+ * ddc_take_physical_address(), so a wait that starts late still returns.
+ */
+void ddc_request_physical_address(TaskHandle_t task, UBaseType_t index);
+
+/**
+ * Take the result of the last request, returns false if it is not ready.
+ */
+bool ddc_take_physical_address(uint16_t *address);
+
+/**
+ * Mark the cached EDID stale, e.g. on a hot-plug.
+ *
+ * The next read compares only the header and checksums with the cache, unless
+ * full is set, which forces the whole EDID to be read and parsed.
+ */
+void ddc_refresh(bool full);
+
+void ddc_get_cache_stats(ddc_cache_stats_t *stats);
 
 #endif
@@ -2,6 +2,7 @@
 #define NVS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "cec-config.h"
 
@@ -14,4 +15,18 @@ void nvs_load_config(cec_config_t *config);
 /** Save configuration to NVS. */
 bool nvs_save_config(const cec_config_t *config);
 
+/** Returns true if the bus has been idle for at least idle_us. */
+typedef bool (*nvs_bus_quiet_t)(uint32_t idle_us);
+
+/**
+ * Create the low priority task that saves config on request.
+ *
+ * Erasing flash stalls every interrupt for tens of milliseconds, so the task
+ * waits until bus_quiet reports an idle bus and writes at most every 30 s.
+ */
+void nvs_task_init(const cec_config_t *config, nvs_bus_quiet_t bus_quiet);
+
+/** Mark the configuration changed, the NVS task saves it later. */
+void nvs_request_save(void);
+
 #endif
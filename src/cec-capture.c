@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "cec-capture.h"
+
+/* Record the CEC line edges into RAM, see cec-capture.h for the format. */
+
+/* Edges recorded after the triggering abort. */
+#define CEC_CAPTURE_POST_MS (50)
+
+/* Block header, the time of the first edge. */
+#define BLOCK_HEADER_SIZE (8)
+
+/* Longest varint, a 32-bit value. */
+#define VARINT_MAX_SIZE (5)
+
+typedef struct {
+  uint16_t len;
+  uint8_t data[CEC_CAPTURE_BLOCK_SIZE];
+} capture_block_t;
+
+static struct {
+  capture_block_t block[CEC_CAPTURE_BLOCKS];
+  uint32_t blocks;  // blocks started, the current one is blocks - 1
+  bool ring;        // overwrite the oldest block when full
+  uint32_t last;    // time of the previous edge
+  uint32_t trigger;
+  volatile cec_capture_state_t state;
+} capture;
+
+volatile bool cec_capture_active = false;
+
+/**
+ * Start a new block at the edge, returns NULL once a linear capture is full.
+ */
+static capture_block_t *next_block(uint32_t now) {
+  if (!capture.ring && (capture.blocks >= CEC_CAPTURE_BLOCKS)) {
+    return NULL;
+  }
+
+  // the header holds the full time since boot
+  uint64_t boot = time_us_64();
+  uint64_t first = boot - (uint32_t)((uint32_t)boot - now);
+
+  capture_block_t *block = &capture.block[capture.blocks % CEC_CAPTURE_BLOCKS];
+  for (unsigned int i = 0; i < BLOCK_HEADER_SIZE; i++) {
+    block->data[i] = (first >> (8 * i)) & 0xff;
+  }
+  block->len = BLOCK_HEADER_SIZE;
+  capture.blocks++;
+  capture.last = now;
+
+  return block;
+}
+
+static void finish(void) {
+  cec_capture_active = false;
+  capture.state = CEC_CAPTURE_DONE;
+}
+
+void cec_capture_edge(uint32_t now, bool level) {
+  capture_block_t *block = &capture.block[(capture.blocks - 1) % CEC_CAPTURE_BLOCKS];
+
+  if ((capture.blocks == 0) || ((block->len + VARINT_MAX_SIZE) > CEC_CAPTURE_BLOCK_SIZE)) {
+    block = next_block(now);
+    if (block == NULL) {
+      finish();
+      return;
+    }
+  }
+
+  uint32_t delta = now - capture.last;
+  uint32_t value = ((delta < (UINT32_MAX >> 1)) ? delta : (UINT32_MAX >> 1)) << 1;
+  value |= level ? 1 : 0;
+  capture.last = now;
+
+  // unsigned LEB128
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    block->data[block->len++] = byte | ((value != 0) ? 0x80 : 0x00);
+  } while (value != 0);
+
+  if ((capture.state == CEC_CAPTURE_TRIGGERED)
+      && ((now - capture.trigger) >= (CEC_CAPTURE_POST_MS * 1000))) {
+    finish();
+  }
+}
+
+void cec_capture_trigger(uint32_t now) {
+  if (capture.state == CEC_CAPTURE_ARMED) {
+    capture.trigger = now;
+    capture.state = CEC_CAPTURE_TRIGGERED;
+  }
+}
+
+void cec_capture_start(bool on_abort) {
+  cec_capture_active = false;
+  __dmb();
+
+  capture.blocks = 0;
+  capture.ring = on_abort;
+  capture.state = on_abort ? CEC_CAPTURE_ARMED : CEC_CAPTURE_RUNNING;
+  __dmb();
+  cec_capture_active = true;
+}
+
+void cec_capture_stop(void) {
+  if (cec_capture_active) {
+    finish();
+  }
+}
+
+cec_capture_state_t cec_capture_get_state(void) {
+  // the bus may have gone quiet after the abort
+  uint32_t status = save_and_disable_interrupts();
+  if ((capture.state == CEC_CAPTURE_TRIGGERED)
+      && ((time_us_32() - capture.trigger) >= (CEC_CAPTURE_POST_MS * 1000))) {
+    finish();
+  }
+  restore_interrupts(status);
+
+  return capture.state;
+}
+
+bool cec_capture_get_block(unsigned int n, const uint8_t **data, size_t *len) {
+  uint32_t first =
+      (capture.blocks > CEC_CAPTURE_BLOCKS) ? (capture.blocks - CEC_CAPTURE_BLOCKS) : 0;
+
+  if ((capture.state != CEC_CAPTURE_DONE) || ((first + n) >= capture.blocks)) {
+    return false;
+  }
+
+  const capture_block_t *block = &capture.block[(first + n) % CEC_CAPTURE_BLOCKS];
+  *data = block->data;
+  *len = block->len;
+
+  return true;
+}
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "cec-config.h"
 #include "class/hid/hid.h"
 #include "tusb.h"
@@ -52,10 +54,10 @@ const char *cec_user_control_name[UINT8_MAX] = {
 };
 
 /**
- * Default EDID probe delay in milliseconds.
+ * Default EDID probe timeout in milliseconds.
  *
- * Number of milliseconds to delay the EDID probe. The DDC bus is shared and a
- * delay can avoid access conflicts.
+ * Upper bound on the wait for the sink's EDID at boot. The EDID is probed with
+ * backoff and read as soon as it answers, as the DDC bus is shared.
  */
 static const uint32_t default_edid_delay_ms = 5000;
 
@@ -76,6 +78,13 @@ static const uint16_t default_physical_addr = 0x0000;
  */
 static const uint8_t default_logical_addr = 0x0f;
 
+/**
+ * Default last allocated logical addresses.
+ *
+ * None, the first allocation polls the full candidate list.
+ */
+static const uint16_t default_last_logical_addrs = 0x0000;
+
 /**
  * Default device type.
  *
@@ -83,6 +92,54 @@ static const uint8_t default_logical_addr = 0x0f;
  */
 static const uint8_t default_device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
 
+/**
+ * Default device types claimed besides the device type.
+ *
+ * None, the audio system bit also receives the TV's volume keys.
+ */
+static const uint8_t default_extra_device_types = 0x00;
+
+/**
+ * Default OSD name.
+ */
+static const char default_osd_name[] = "RetroTink4K";
+
+/**
+ * Default vendor ID.
+ */
+static const uint32_t default_vendor_id = 0x0010FA;
+
+/**
+ * Default receive timing preset.
+ */
+static const cec_config_timing_t default_rx_timing_type = CEC_CONFIG_TIMING_STRICT;
+
+/**
+ * Receive acceptance windows required by the specification.
+ *
+ * From "High-Definition Multimedia Interface Specification Version 1.3, CEC
+ * 5.2.1 Start Bit Timing and 5.2.2 Data Bit Timing"
+ */
+const cec_config_rx_timing_t cec_config_spec_rx_timing = {
+    .start_low = {3500, 3900},
+    .start_period = {4300, 4700},
+    .one_low = {400, 800},
+    .zero_low = {1300, 1700},
+    .bit_period = {2050, 2750},
+};
+
+/**
+ * Wider receive windows, still clear of each other, for sinks running their
+ * CEC clock off specification.
+ */
+static const cec_config_rx_timing_t relaxed_rx_timing = {
+    .start_low = {3300, 4100},
+    .start_period = {4100, 4900},
+    .one_low = {300, 950},
+    .zero_low = {1150, 1900},
+    .bit_period = {1900, 2950},
+};
+
 /**
  * Default (Kodi) key mapping from HDMI user control to HID keyboard entry.
  */
@@ -153,7 +210,14 @@ void cec_config_set_default(cec_config_t *config) {
   config->edid_delay_ms = default_edid_delay_ms;
   config->physical_address = default_physical_addr;
   config->logical_address = default_logical_addr;
+  config->last_logical_addresses = default_last_logical_addrs;
   config->device_type = default_device_type;
+  config->extra_device_types = default_extra_device_types;
+  config->rx_timing_type = default_rx_timing_type;
+  config->rx_timing = cec_config_spec_rx_timing;
+  memset(config->rx_offset, 0, sizeof(config->rx_offset));
+  strncpy(config->osd_name, default_osd_name, sizeof(config->osd_name));
+  config->vendor_id = default_vendor_id;
 #if KEYMAP_DEFAULT_KODI
   config->keymap_type = CEC_CONFIG_KEYMAP_KODI;
 #elif KEYMAP_DEFAULT_MISTER
@@ -189,6 +253,59 @@ void cec_config_set_keymap(cec_config_t *config) {
   }
 }
 
+/**
+ * Check custom windows are usable: none is empty, the shortest starts above a
+ * glitch, and the windows a low time or a period is classified by are in
+ * order without overlapping.
+ */
+static bool rx_timing_valid(const cec_config_rx_timing_t *t) {
+  if ((t->start_low.min > t->start_low.max) || (t->start_period.min > t->start_period.max)
+      || (t->one_low.min > t->one_low.max) || (t->zero_low.min > t->zero_low.max)
+      || (t->bit_period.min > t->bit_period.max)) {
+    return false;
+  }
+  if (t->one_low.min <= CEC_RX_GLITCH_US) {
+    return false;
+  }
+
+  return (t->one_low.max < t->zero_low.min) && (t->zero_low.max < t->start_low.min)
+         && (t->bit_period.max < t->start_period.min);
+}
+
+void cec_config_set_rx_timing(cec_config_t *config) {
+  cec_config_rx_timing_t previous;
+
+  if (config == NULL) {
+    return;
+  }
+
+  previous = config->rx_timing;
+  switch (config->rx_timing_type) {
+    case CEC_CONFIG_TIMING_STRICT:
+      config->rx_timing = cec_config_spec_rx_timing;
+      break;
+    case CEC_CONFIG_TIMING_RELAXED:
+      config->rx_timing = relaxed_rx_timing;
+      break;
+    case CEC_CONFIG_TIMING_CUSTOM:
+      // should already be loaded
+      if (!rx_timing_valid(&config->rx_timing)) {
+        config->rx_timing_type = CEC_CONFIG_TIMING_STRICT;
+        config->rx_timing = cec_config_spec_rx_timing;
+      }
+      break;
+    default:
+      config->rx_timing_type = CEC_CONFIG_TIMING_STRICT;
+      config->rx_timing = cec_config_spec_rx_timing;
+      break;
+  }
+
+  if (memcmp(&previous, &config->rx_timing, sizeof(previous)) != 0) {
+    // the shifts were learnt against the old windows
+    memset(config->rx_offset, 0, sizeof(config->rx_offset));
+  }
+}
+
 void cec_config_complete(cec_config_t *config) {
   for (uint8_t i = 0; i < UINT8_MAX; i++) {
     if (config->keymap[i].key != 0x00) {
@@ -196,4 +313,14 @@ void cec_config_complete(cec_config_t *config) {
       config->keymap[i].name = name;
     }
   }
+
+  // settings read from flash are not trusted
+  if (config->device_type > CEC_CONFIG_DEVICE_TYPE_AUDIO_SYSTEM) {
+    config->device_type = default_device_type;
+  }
+  config->osd_name[CEC_CONFIG_OSD_NAME_LEN] = '\0';
+  if (config->osd_name[0] == '\0') {
+    strncpy(config->osd_name, default_osd_name, sizeof(config->osd_name));
+  }
+  config->vendor_id &= 0x00ffffff;
 }
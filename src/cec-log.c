@@ -1,10 +1,14 @@
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "FreeRTOS.h"
 #include "message_buffer.h"
 #include "task.h"
 
+#include "hardware/sync.h"
+
 #include "cec-log.h"
 #include "usb-cdc.h"
 
@@ -12,6 +16,7 @@
 #define LOG_LINE_LENGTH (64)
 #define LOG_QUEUE_LENGTH (16)
 #define LOG_MB_SIZE (LOG_LINE_LENGTH * LOG_QUEUE_LENGTH)
+#define LOG_FRAME_RING_SIZE (16)
 
 static StaticTask_t log_task_static;
 static StackType_t log_stack[LOG_TASK_STACK_SIZE];
@@ -22,13 +27,84 @@ static uint8_t log_mb_storage[LOG_MB_SIZE];
 
 static volatile bool enabled = false;
 
+/* Categories logged while enabled. */
+static uint32_t mask = CEC_LOG_ALL;
+
+volatile uint32_t cec_log_active = 0;
+
+/**
+ * Frame records, written by one task at head and consumed by the log task at
+ * tail. No lock is needed as each index has a single writer.
+ */
+typedef struct {
+  cec_log_frame_t record[LOG_FRAME_RING_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+  uint32_t dropped_logged;  // dropped count already reported by the log task
+} frame_ring_t;
+
+static frame_ring_t frame_ring[CEC_LOG_RING_COUNT];
+
+static cec_log_format_t frame_format;
+
+/**
+ * Get the ring holding the oldest frame record, NULL if all are empty.
+ */
+static frame_ring_t *oldest_frame_ring(void) {
+  frame_ring_t *oldest = NULL;
+
+  for (unsigned int i = 0; i < CEC_LOG_RING_COUNT; i++) {
+    frame_ring_t *ring = &frame_ring[i];
+    if (ring->head == ring->tail) {
+      continue;
+    }
+    if ((oldest == NULL) || (ring->record[ring->tail % LOG_FRAME_RING_SIZE].timestamp <
+                             oldest->record[oldest->tail % LOG_FRAME_RING_SIZE].timestamp)) {
+      oldest = ring;
+    }
+  }
+
+  return oldest;
+}
+
+/**
+ * Format the queued frame records in time order.
+ */
+static void log_frames(void) {
+  char buffer[LOG_LINE_LENGTH * 2];
+  uint32_t dropped = 0;
+  frame_ring_t *ring;
+
+  while ((ring = oldest_frame_ring()) != NULL) {
+    // read the record only once it has been published
+    __dmb();
+    if (frame_format != NULL) {
+      frame_format(&ring->record[ring->tail % LOG_FRAME_RING_SIZE], buffer, sizeof(buffer));
+      fputs(buffer, stdout);
+    }
+    __dmb();
+    ring->tail++;
+  }
+
+  for (unsigned int i = 0; i < CEC_LOG_RING_COUNT; i++) {
+    uint32_t count = frame_ring[i].dropped;
+    dropped += count - frame_ring[i].dropped_logged;
+    frame_ring[i].dropped_logged = count;
+  }
+  if (dropped > 0) {
+    printf("%" PRIu32 " frames not logged"_CDC_BR, dropped);
+  }
+}
+
 static void cec_log_task(void *param) {
   while (true) {
     char buffer[LOG_LINE_LENGTH];
 
     size_t bytes = xMessageBufferReceive(log_mb, buffer, sizeof(buffer), pdMS_TO_TICKS(10));
+    log_frames();
     if (bytes > 0) {
-      //cdc_log(buffer);
+      fputs(buffer, stdout);
     }
   }
 }
@@ -47,10 +123,23 @@ bool cec_log_enabled(void) {
 
 void cec_log_enable(void) {
   enabled = true;
+  cec_log_active = mask;
 }
 
 void cec_log_disable(void) {
   enabled = false;
+  cec_log_active = 0;
+}
+
+void cec_log_set_mask(uint32_t categories) {
+  mask = categories & CEC_LOG_ALL;
+  if (enabled) {
+    cec_log_active = mask;
+  }
+}
+
+uint32_t cec_log_get_mask(void) {
+  return mask;
 }
 
 void cec_log_vsubmitf(const char *fmt, va_list ap) {
@@ -70,3 +159,34 @@ void cec_log_submitf(const char *fmt, ...) {
   cec_log_vsubmitf(fmt, ap);
   va_end(ap);
 }
+
+void cec_log_frame(cec_log_ring_t ring,
+                   uint64_t timestamp,
+                   const uint8_t *data,
+                   uint8_t len,
+                   uint8_t flags) {
+  if (!enabled) {
+    return;
+  }
+
+  frame_ring_t *r = &frame_ring[ring];
+  uint32_t head = r->head;
+  if ((head - r->tail) >= LOG_FRAME_RING_SIZE) {
+    r->dropped++;
+    return;
+  }
+
+  cec_log_frame_t *record = &r->record[head % LOG_FRAME_RING_SIZE];
+  record->timestamp = timestamp;
+  record->flags = flags;
+  record->len = (len < sizeof(record->data)) ? len : sizeof(record->data);
+  memcpy(record->data, data, record->len);
+
+  // publish the record only once it is complete
+  __dmb();
+  r->head = head + 1;
+}
+
+void cec_log_set_format(cec_log_format_t format) {
+  frame_format = format;
+}
@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "crc/crc32.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+
+#include "cec-capture.h"
+#include "cec-monitor.h"
+
+/* Stream every frame seen on the bus to a UART, see cec-monitor.h for the
+ * trace format.
+ */
+
+#ifndef CEC_MONITOR_UART
+#define CEC_MONITOR_UART PICO_DEFAULT_UART
+#endif
+#ifndef CEC_MONITOR_TX_PIN
+#define CEC_MONITOR_TX_PIN PICO_DEFAULT_UART_TX_PIN
+#endif
+#ifndef CEC_MONITOR_BAUD
+#define CEC_MONITOR_BAUD (115200)
+#endif
+
+#define MONITOR_TASK_STACK_SIZE (512)
+#define MONITOR_RING_SIZE (64)
+#define MONITOR_POLL_MS (10)
+
+/* Sync, type and length before the payload, CRC after it. */
+#define TRACE_HEADER_SIZE (4)
+#define TRACE_CRC_SIZE (4)
+#define TRACE_FRAME_SIZE (14)
+#define TRACE_PAYLOAD_MAX (UINT8_MAX)
+
+typedef struct {
+  uint64_t start;
+  uint32_t duration;
+  uint8_t flags;
+  uint8_t abort;
+  uint8_t len;
+  uint8_t data[16];
+} monitor_frame_t;
+
+/**
+ * Captured frames, written by the receive interrupt at head and streamed by
+ * the monitor task from tail.
+ */
+static struct {
+  monitor_frame_t frame[MONITOR_RING_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t captured;
+  volatile uint32_t dropped;
+  volatile bool header;  // send the stream header first
+} monitor;
+
+volatile bool cec_monitor_active = false;
+
+static uart_inst_t *monitor_uart;
+
+void cec_monitor_capture(uint64_t start,
+                         uint64_t end,
+                         const uint8_t *data,
+                         uint8_t len,
+                         uint8_t flags,
+                         uint8_t abort) {
+  uint32_t head = monitor.head;
+
+  if ((head - monitor.tail) >= MONITOR_RING_SIZE) {
+    monitor.dropped++;
+    return;
+  }
+
+  monitor_frame_t *frame = &monitor.frame[head % MONITOR_RING_SIZE];
+  frame->start = start;
+  frame->duration = (uint32_t)(end - start);
+  frame->flags = flags;
+  frame->abort = abort;
+  frame->len = (len < sizeof(frame->data)) ? len : sizeof(frame->data);
+  memcpy(frame->data, data, frame->len);
+  monitor.captured++;
+
+  // publish the frame only once it is complete
+  __dmb();
+  monitor.head = head + 1;
+}
+
+static void put_le(uint8_t *buf, uint64_t value, unsigned int len) {
+  for (unsigned int i = 0; i < len; i++) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+/**
+ * Frame and send one trace record.
+ */
+static void send_record(cec_trace_type_t type, const uint8_t *payload, uint8_t len) {
+  uint8_t record[TRACE_HEADER_SIZE + TRACE_PAYLOAD_MAX + TRACE_CRC_SIZE];
+
+  record[0] = CEC_TRACE_SYNC0;
+  record[1] = CEC_TRACE_SYNC1;
+  record[2] = type;
+  record[3] = len;
+  memcpy(&record[TRACE_HEADER_SIZE], payload, len);
+  put_le(&record[TRACE_HEADER_SIZE + len], crc32(&record[2], len + 2), TRACE_CRC_SIZE);
+
+  uart_write_blocking(monitor_uart, record, TRACE_HEADER_SIZE + len + TRACE_CRC_SIZE);
+}
+
+static void send_frame(const monitor_frame_t *frame) {
+  uint8_t payload[TRACE_FRAME_SIZE + 16];
+
+  put_le(&payload[0], frame->start, 8);
+  put_le(&payload[8], frame->duration, 4);
+  payload[12] = frame->flags;
+  payload[13] = frame->abort;
+  memcpy(&payload[TRACE_FRAME_SIZE], frame->data, frame->len);
+
+  send_record(CEC_TRACE_FRAME, payload, TRACE_FRAME_SIZE + frame->len);
+}
+
+/**
+ * Send a finished edge capture, one record per block.
+ */
+static void send_edges(void) {
+  const uint8_t *data;
+  size_t len;
+
+  for (unsigned int n = 0; cec_capture_get_block(n, &data, &len); n++) {
+    send_record(CEC_TRACE_EDGES, data, len);
+  }
+}
+
+static void cec_monitor_task(void *param) {
+  uint32_t dropped_sent = 0;
+
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(MONITOR_POLL_MS));
+
+    if (monitor.header) {
+      uint8_t version = CEC_TRACE_VERSION;
+      send_record(CEC_TRACE_HEADER, &version, sizeof(version));
+      monitor.header = false;
+      dropped_sent = 0;
+    }
+
+    while (monitor.tail != monitor.head) {
+      // read the frame only once it has been published
+      __dmb();
+      monitor_frame_t frame = monitor.frame[monitor.tail % MONITOR_RING_SIZE];
+      __dmb();
+      monitor.tail++;
+      send_frame(&frame);
+    }
+
+    uint32_t dropped = monitor.dropped;
+    if (dropped != dropped_sent) {
+      uint8_t payload[4];
+      put_le(payload, dropped, sizeof(payload));
+      send_record(CEC_TRACE_DROP, payload, sizeof(payload));
+      dropped_sent = dropped;
+    }
+
+    if (cec_capture_get_state() == CEC_CAPTURE_DONE) {
+      send_edges();
+      cec_capture_start(true);
+    }
+  }
+}
+
+void cec_monitor_init(void) {
+  static StaticTask_t monitor_task_static;
+  static StackType_t monitor_stack[MONITOR_TASK_STACK_SIZE];
+
+  monitor_uart = uart_get_instance(CEC_MONITOR_UART);
+  uart_init(monitor_uart, CEC_MONITOR_BAUD);
+  gpio_set_function(CEC_MONITOR_TX_PIN, GPIO_FUNC_UART);
+
+  xTaskCreateStatic(cec_monitor_task, "monitor", MONITOR_TASK_STACK_SIZE, NULL,
+                    configMAX_PRIORITIES - 4, &monitor_stack[0], &monitor_task_static);
+
+  cec_monitor_start();
+  cec_capture_start(true);
+}
+
+void cec_monitor_start(void) {
+  if (cec_monitor_active) {
+    return;
+  }
+
+  monitor.captured = 0;
+  monitor.dropped = 0;
+  monitor.header = true;
+  __dmb();
+  cec_monitor_active = true;
+}
+
+void cec_monitor_stop(void) {
+  cec_monitor_active = false;
+}
+
+void cec_monitor_get_counts(uint32_t *captured, uint32_t *dropped) {
+  *captured = monitor.captured;
+  *dropped = monitor.dropped;
+}
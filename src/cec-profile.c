@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "cec-profile.h"
+
+/* Time interrupt handlers, see cec-profile.h. */
+
+/* Cycles below the second histogram bucket. */
+#define PROFILE_FIRST_BITS (5)
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[CEC_PROFILE_BUCKETS];
+} profile_t;
+
+/*
+ * Each point is written by a single handler, which never preempts itself, so
+ * needs no lock.
+ */
+static profile_t profile[CEC_PROFILE_COUNT];
+
+/* Entry of the USB host interrupt in progress. */
+static uint32_t usb_begin;
+
+void cec_profile_end(cec_profile_point_t point, uint32_t begin) {
+  uint32_t end = systick_hw->cvr;
+  // SysTick counts down, reloading every RTOS tick
+  uint32_t cycles = (begin >= end) ? (begin - end) : (begin + systick_hw->rvr + 1 - end);
+  profile_t *p = &profile[point];
+
+  if ((p->count == 0) || (cycles < p->min)) {
+    p->min = cycles;
+  }
+  if (cycles > p->max) {
+    p->max = cycles;
+  }
+  p->count++;
+  p->total += cycles;
+
+  uint32_t bits = (cycles != 0) ? (32 - __builtin_clz(cycles)) : 0;
+  uint32_t bucket = (bits > PROFILE_FIRST_BITS) ? (bits - PROFILE_FIRST_BITS) : 0;
+  p->hist[(bucket < CEC_PROFILE_BUCKETS) ? bucket : (CEC_PROFILE_BUCKETS - 1)]++;
+}
+
+static void usb_irq_enter(void) {
+  usb_begin = cec_profile_begin();
+}
+
+static void usb_irq_exit(void) {
+  cec_profile_end(CEC_PROFILE_USB_HOST, usb_begin);
+}
+
+void cec_profile_usb_init(void) {
+  // shared handlers of equal order priority run newest first, so these bracket TinyUSB's
+  irq_add_shared_handler(USBCTRL_IRQ, &usb_irq_enter,
+                         PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+  irq_add_shared_handler(USBCTRL_IRQ, &usb_irq_exit, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
+}
+
+void cec_profile_get(cec_profile_point_t point, cec_profile_stats_t *stats) {
+  profile_t p;
+
+  uint32_t status = save_and_disable_interrupts();
+  p = profile[point];
+  restore_interrupts(status);
+
+  stats->count = p.count;
+  stats->min = p.min;
+  stats->mean = (p.count > 0) ? (uint32_t)(p.total / p.count) : 0;
+  stats->max = p.max;
+  memcpy(stats->hist, p.hist, sizeof(stats->hist));
+}
+
+void cec_profile_reset(void) {
+  uint32_t status = save_and_disable_interrupts();
+  memset(profile, 0, sizeof(profile));
+  restore_interrupts(status);
+}
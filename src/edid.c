@@ -0,0 +1,209 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cec-log.h"
+#include "edid.h"
+#include "usb-cdc.h"
+
+/* EDID parsing, independent of the DDC bus. */
+
+#define EDID_CTA_DTD_START (0x02)
+#define EDID_CTA_DBC_OFFSET (0x04)
+
+/* DisplayID section, embedded in an extension block after the tag byte. */
+#define DISPLAYID_SECTION_LEN (0x02)
+#define DISPLAYID_DB_OFFSET (0x05)
+#define DISPLAYID_DB_HEADER (3)
+#define DISPLAYID_TAG_CTA (0x81)
+
+/* A block map names the tags of the following 126 blocks. */
+#define EDID_BLOCK_MAP_ENTRIES (126)
+
+static const uint8_t header[EDID_HEADER_SIZE] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+static const uint8_t hdmi_oui[3] = {0x03, 0x0c, 0x00};
+static const uint8_t hf_oui[3] = {0xd8, 0x5d, 0xc4};
+
+bool edid_header_valid(const uint8_t *block) {
+  return memcmp(block, header, EDID_HEADER_SIZE) == 0;
+}
+
+bool edid_block_valid(const uint8_t *block) {
+  uint8_t cksum = 0x00;
+
+  for (size_t i = 0; i < EDID_BLOCK_SIZE; i++) {
+    cksum += block[i];
+  }
+
+  return cksum == 0x00;
+}
+
+void edid_cta_iter_init_range(edid_cta_iter_t *it, const uint8_t *data, size_t len) {
+  it->next = data;
+  it->end = data + len;
+}
+
+void edid_cta_iter_init(edid_cta_iter_t *it, const uint8_t *block) {
+  uint8_t dtd = block[EDID_CTA_DTD_START];
+
+  // 0 means no DTDs and no data blocks
+  if ((dtd <= EDID_CTA_DBC_OFFSET) || (dtd > EDID_CHECKSUM)) {
+    edid_cta_iter_init_range(it, &block[EDID_CTA_DBC_OFFSET], 0);
+  } else {
+    edid_cta_iter_init_range(it, &block[EDID_CTA_DBC_OFFSET], dtd - EDID_CTA_DBC_OFFSET);
+  }
+}
+
+bool edid_cta_iter_next(edid_cta_iter_t *it, edid_cta_db_t *db) {
+  if (it->next >= it->end) {
+    return false;
+  }
+
+  uint8_t len = it->next[0] & 0x1f;
+  if ((it->end - it->next) < (len + 1)) {
+    // payload runs past the collection
+    it->next = it->end;
+    return false;
+  }
+
+  db->tag = it->next[0] >> 5;
+  db->len = len;
+  db->payload = &it->next[1];
+  it->next += len + 1;  // payload + header
+
+  return true;
+}
+
+/**
+ * Search CTA data blocks for the HDMI VSDB.
+ */
+static uint16_t find_physical_address(edid_cta_iter_t *it) {
+  edid_cta_db_t db;
+
+  while (edid_cta_iter_next(it, &db)) {
+    if ((db.tag != EDID_CTA_TAG_VENDOR) || (db.len < 3)) {
+      continue;
+    }
+
+    if (memcmp(db.payload, hf_oui, 3) == 0) {
+      CEC_LOG_DEBUG(CEC_LOG_DDC, "  HF-VSDB"_CDC_BR);
+      continue;
+    }
+
+    if ((memcmp(db.payload, hdmi_oui, 3) == 0) && (db.len >= 5)) {
+      // HDMI Licensing, LLC block
+      uint16_t addr = (db.payload[3] << 8) | db.payload[4];
+      CEC_LOG_INFO(CEC_LOG_DDC, "  physical address = %04x"_CDC_BR, addr);
+      return addr;
+    }
+  }
+
+  return 0x0000;
+}
+
+/**
+ * Search the CTA data blocks in a DisplayID extension block.
+ */
+static uint16_t find_displayid_physical_address(const uint8_t *block) {
+  size_t end = DISPLAYID_DB_OFFSET + block[DISPLAYID_SECTION_LEN];
+
+  if (end > EDID_CHECKSUM) {
+    end = EDID_CHECKSUM;
+  }
+
+  for (size_t i = DISPLAYID_DB_OFFSET; (i + DISPLAYID_DB_HEADER) <= end;) {
+    const uint8_t *db = &block[i];
+    size_t len = db[2];
+
+    if ((i + DISPLAYID_DB_HEADER + len) > end) {
+      break;
+    }
+
+    if (db[0] == DISPLAYID_TAG_CTA) {
+      edid_cta_iter_t it;
+      edid_cta_iter_init_range(&it, &db[DISPLAYID_DB_HEADER], len);
+
+      uint16_t addr = find_physical_address(&it);
+      if (addr != 0x0000) {
+        return addr;
+      }
+    }
+
+    i += DISPLAYID_DB_HEADER + len;
+  }
+
+  return 0x0000;
+}
+
+/**
+ * Check whether a block tag from a block map is worth reading.
+ */
+static bool wanted(uint8_t tag) {
+  return (tag == EDID_TAG_CTA) || (tag == EDID_TAG_DISPLAYID) || (tag == EDID_TAG_BLOCK_MAP);
+}
+
+bool edid_find_physical_address(edid_read_block_t read,
+                                void *ctx,
+                                uint16_t *address,
+                                uint8_t *block) {
+  uint8_t data[EDID_BLOCK_SIZE];
+  uint8_t map[EDID_BLOCK_SIZE];
+  unsigned int map_block = 0;  // 0 when there is no block map
+
+  *address = 0x0000;
+  *block = 0;
+
+  if (read(0, data, ctx)) {
+    return false;
+  }
+
+  if (!edid_header_valid(data)) {
+    // not an EDID block
+    return true;
+  }
+
+  unsigned int extensions = data[EDID_EXTENSIONS];
+  if (extensions == 0) {
+    CEC_LOG_WARN(CEC_LOG_DDC, "Missing CTA extensions"_CDC_BR);
+    return true;
+  }
+
+  for (unsigned int n = 1; n <= extensions; n++) {
+    if ((map_block != 0) && ((n - map_block) <= EDID_BLOCK_MAP_ENTRIES) &&
+        !wanted(map[n - map_block])) {
+      continue;
+    }
+
+    if (read(n, data, ctx)) {
+      return false;
+    }
+
+    uint16_t addr = 0x0000;
+    switch (data[0]) {
+      case EDID_TAG_BLOCK_MAP:
+        memcpy(map, data, EDID_BLOCK_SIZE);
+        map_block = n;
+        break;
+      case EDID_TAG_CTA: {
+        edid_cta_iter_t it;
+        CEC_LOG_DEBUG(CEC_LOG_DDC, " CTA Extension %u"_CDC_BR, n);
+        edid_cta_iter_init(&it, data);
+        addr = find_physical_address(&it);
+      } break;
+      case EDID_TAG_DISPLAYID:
+        CEC_LOG_DEBUG(CEC_LOG_DDC, " DisplayID Extension %u"_CDC_BR, n);
+        addr = find_displayid_physical_address(data);
+        break;
+      default:
+        break;
+    }
+
+    if (addr != 0x0000) {
+      *address = addr;
+      *block = n;
+      break;
+    }
+  }
+
+  return true;
+}
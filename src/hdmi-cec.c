@@ -6,13 +6,28 @@
 #include "task.h"
 
 #include "class/hid/hid.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
 #include "pico/stdlib.h"
 #include "tusb.h"
 
+#if CEC_PHY_PIO
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hdmi-cec.pio.h"
+#elif CEC_PHY_GPIO
+#include "hardware/structs/iobank0.h"
+#include "hardware/structs/timer.h"
+#else
+#error "Unknown CEC PHY."
+#endif
+
 #include "blink.h"
+#include "cec-capture.h"
 #include "cec-config.h"
 #include "cec-log.h"
+#include "cec-monitor.h"
+#include "cec-profile.h"
 #include "hdmi-cec.h"
 #include "hdmi-ddc.h"
 #include "nvs.h"
@@ -29,11 +44,22 @@
 
 #define NOTIFY_RX ((UBaseType_t)0)
 #define NOTIFY_TX ((UBaseType_t)1)
+/* cec_task only ever blocks in recv_frame(), so DDC results wake that wait. */
+#define NOTIFY_DDC NOTIFY_RX
+#define NOTIFY_TX_QUEUE ((UBaseType_t)0)
+
+#define CEC_TX_STACK_SIZE (1024)
+#define CEC_TX_REPLY_QUEUE_LENGTH (8)
+#define CEC_TX_BROADCAST_QUEUE_LENGTH (4)
+#define CEC_TX_POLL_QUEUE_LENGTH (4)
 
 typedef enum {
   CEC_ID_FEATURE_ABORT = 0x00,
   CEC_ID_IMAGE_VIEW_ON = 0x04,
   CEC_ID_TEXT_VIEW_ON = 0x0d,
+  CEC_ID_GIVE_DECK_STATUS = 0x1a,
+  CEC_ID_DECK_STATUS = 0x1b,
+  CEC_ID_SET_MENU_LANGUAGE = 0x32,
   CEC_ID_STANDBY = 0x36,
   CEC_ID_USER_CONTROL_PRESSED = 0x44,
   CEC_ID_USER_CONTROL_RELEASED = 0x45,
@@ -53,52 +79,50 @@ typedef enum {
   CEC_ID_SET_STREAM_PATH = 0x86,
   CEC_ID_DEVICE_VENDOR_ID = 0x87,
   CEC_ID_GIVE_DEVICE_VENDOR_ID = 0x8c,
+  CEC_ID_MENU_REQUEST = 0x8d,
   CEC_ID_MENU_STATUS = 0x8e,
   CEC_ID_GIVE_DEVICE_POWER_STATUS = 0x8f,
   CEC_ID_REPORT_POWER_STATUS = 0x90,
-  CEC_ID_GET_MENU_LANGUAGE = 0x81,
+  CEC_ID_GET_MENU_LANGUAGE = 0x91,
   CEC_ID_INACTIVE_SOURCE = 0x9d,
   CEC_ID_CEC_VERSION = 0x9e,
   CEC_ID_GET_CEC_VERSION = 0x9f,
   CEC_ID_VENDOR_COMMAND_WITH_ID = 0xa0,
+  CEC_ID_GIVE_FEATURES = 0xa5,
+  CEC_ID_REPORT_FEATURES = 0xa6,
   CEC_ID_REQUEST_ARC_INITIATION = 0xc3,
   CEC_ID_ABORT = 0xff,
 } cec_id_t;
 
-const char *cec_message[] = {
-    [CEC_ID_FEATURE_ABORT] = "Feature Abort",
-    [CEC_ID_IMAGE_VIEW_ON] = "Image View On",
-    [CEC_ID_TEXT_VIEW_ON] = "Text View On",
-    [CEC_ID_STANDBY] = "Standby",
-    [CEC_ID_USER_CONTROL_PRESSED] = "User Control Pressed",
-    [CEC_ID_USER_CONTROL_RELEASED] = "User Control Released",
-    [CEC_ID_GIVE_OSD_NAME] = "Give OSD Name",
-    [CEC_ID_SET_OSD_NAME] = "Set OSD Name",
-    [CEC_ID_SYSTEM_AUDIO_MODE_REQUEST] = "System Audio Mode Request",
-    [CEC_ID_GIVE_AUDIO_STATUS] = "Give Audio Status",
-    [CEC_ID_SET_SYSTEM_AUDIO_MODE] = "Set System Audio Mode",
-    [CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS] = "Give System Audio Mode",
-    [CEC_ID_SYSTEM_AUDIO_MODE_STATUS] = "System Audio Mode Status",
-    [CEC_ID_REPORT_AUDIO_STATUS] = "Report Audio Status",
-    [CEC_ID_ROUTING_CHANGE] = "Routing Change",
-    [CEC_ID_ACTIVE_SOURCE] = "Active Source",
-    [CEC_ID_GIVE_PHYSICAL_ADDRESS] = "Give Physical Address",
-    [CEC_ID_REPORT_PHYSICAL_ADDRESS] = "Report Physical Address",
-    [CEC_ID_REQUEST_ACTIVE_SOURCE] = "Request Active Source",
-    [CEC_ID_SET_STREAM_PATH] = "Set Stream Path",
-    [CEC_ID_DEVICE_VENDOR_ID] = "Device Vendor ID",
-    [CEC_ID_GIVE_DEVICE_VENDOR_ID] = "Give Device Vendor ID",
-    [CEC_ID_MENU_STATUS] = "Menu Status",
-    [CEC_ID_GIVE_DEVICE_POWER_STATUS] = "Give Device Power Status",
-    [CEC_ID_REPORT_POWER_STATUS] = "Report Power Status",
-    [CEC_ID_GET_MENU_LANGUAGE] = "Get Menu Language",
-    [CEC_ID_INACTIVE_SOURCE] = "Inactive Source",
-    [CEC_ID_CEC_VERSION] = "CEC Version",
-    [CEC_ID_GET_CEC_VERSION] = "Get CEC Version",
-    [CEC_ID_VENDOR_COMMAND_WITH_ID] = "Vendor Command With ID",
-    [CEC_ID_REQUEST_ARC_INITIATION] = "Request ARC Initiation",
-    [CEC_ID_ABORT] = "Abort",
-};
+/* Addressing accepted for an opcode. */
+typedef enum {
+  CEC_ADDR_DIRECTED = 0x01,
+  CEC_ADDR_BROADCAST = 0x02,
+  CEC_ADDR_BOTH = 0x03,
+} cec_addressing_t;
+
+/* Handle a frame, the length and addressing have already been checked. */
+typedef void (*cec_handler_t)(uint8_t initiator,
+                              uint8_t destination,
+                              const uint8_t *pld,
+                              uint8_t pldcnt);
+
+/* Format the operands of a frame for the log, the length has been checked. */
+typedef void (*cec_decode_t)(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size);
+
+typedef struct {
+  const char *name;             // NULL for opcodes we do not know
+  uint8_t operands;             // minimum number of operand bytes
+  cec_addressing_t addressing;  // frames passed to the handler
+  cec_handler_t handler;        // NULL to accept and ignore
+  cec_decode_t decode;          // NULL to log the name only
+} cec_opcode_t;
+
+/* One entry per opcode, drives both the dispatcher and the frame log. */
+static const cec_opcode_t cec_opcode[UINT8_MAX + 1];
+
+/* Per opcode counters, indexed by opcode. */
+static cec_opcode_stats_t opcode_stats[UINT8_MAX + 1];
 
 typedef enum {
   CEC_ABORT_UNRECOGNIZED = 0,
@@ -122,31 +146,93 @@ const char *cec_feature_abort_reason[] = {
 static cec_config_t config = {0x0};
 
 // HDMI logical addresses
-// 2 dimensional array of valid logical addresses for playback and recording
-// only.
+// 2 dimensional array of candidate logical addresses per device type, in
+// allocation order and ended by 0x0f.
 #define NUM_LADDRESS 4
 #define NUM_TYPES 6
 static const uint8_t laddress[NUM_TYPES][NUM_LADDRESS] = {
-    {0x00, 0x00, 0x00, 0x00},  // TV
+    {0x00, 0x0f, 0x0f, 0x0f},  // TV
     {0x01, 0x02, 0x09, 0x0f},  // Recording Device
     {0x0f, 0x0f, 0x0f, 0x0f},  // Reserved
     {0x03, 0x06, 0x07, 0x0f},  // Tuner + 0x0a
     {0x04, 0x08, 0x0b, 0x0f},  // Playback Device
-    {0x05, 0x05, 0x05, 0x05},  // Audio System
+    {0x05, 0x0f, 0x0f, 0x0f},  // Audio System
 };
 
-/* The HDMI address for this device.  Respond to CEC sent to this address. */
+/* Device types that are never claimed. */
+#define LADDRESS_UNCLAIMABLE \
+  ((1u << CEC_CONFIG_DEVICE_TYPE_TV) | (1u << CEC_CONFIG_DEVICE_TYPE_RESERVED))
+
+/* The HDMI address of the configured device type, initiator of broadcasts. */
 static uint8_t laddr = 0x0f;
 
+/* Every claimed logical address, a bit per address.  Respond to CEC sent to these. */
+static uint16_t laddr_mask = 0x0000;
+
+/* Logical address claimed per device type, 0x0f if none. */
+static uint8_t type_laddr[NUM_TYPES] = {0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f};
+
 /* The HDMI physical address. */
 static uint16_t paddr = 0x0000;
 
+/* Allocated logical address per device type, revalidated only when the topology changes. */
+static struct {
+  bool valid;
+  bool conflict;  // another device sent a frame from our logical address
+  uint16_t paddr;  // physical address the logical address was allocated for
+  uint8_t laddr;
+} laddr_cache[NUM_TYPES];
+
+/* Time to collect routing changes and address reports before acting on them. */
+#define TOPOLOGY_SETTLE_MS (200)
+
+/* Topology change pending, coalesced into a single re-evaluation. */
+static struct {
+  bool pending;
+  bool waiting;  // physical address requested from the DDC task
+  bool routing;  // routing change, we may be the new active source
+  bool report;   // TV reported its physical address, report ours
+  bool hotplug;  // sink re-plugged, read the full EDID and poll again
+  TickType_t due;
+} topology;
+
 /* Active state. */
 static uint16_t active_addr = 0x0000;
 
 /* Audio state. */
 static bool audio_status = false;
 
+/* A reply built ahead of the request, without its header block. */
+typedef struct {
+  uint8_t data[15];
+  uint8_t len;
+} cec_reply_t;
+
+/* Replies that only change with the configuration or the physical address. */
+typedef struct {
+  cec_reply_t osd_name;
+  cec_reply_t vendor_id;
+  cec_reply_t cec_version;
+  cec_reply_t power_status[2];              // on, standby
+  cec_reply_t physical_address[NUM_TYPES];  // per device type
+} reply_cache_t;
+
+/*
+ * Cached replies, double buffered. Queued replies point into the current
+ * copy, which is never written; a rebuild fills the other copy and swaps.
+ */
+static reply_cache_t reply_caches[2];
+static reply_cache_t *reply_cache = &reply_caches[0];
+
+/* Replies queued from each copy and not yet taken by cec_tx. */
+static uint8_t reply_cache_queued[2];
+
+/* Wait between checks for the replies queued from a copy to be taken. */
+#define REPLY_CACHE_POLL_MS (5)
+
+/* Menu state, as set by Menu Request. */
+static bool menu_active = true;
+
 /* CEC statistics. */
 static hdmi_cec_stats_t cec_stats;
 
@@ -155,6 +241,36 @@ static hdmi_cec_stats_t cec_stats;
 
 TaskHandle_t xCECTask;
 
+/* Transmit task, sends queued frames in priority order. */
+static TaskHandle_t xCECTxTask;
+
+typedef struct {
+  uint8_t data[16];
+  uint8_t len;
+  const cec_reply_t *reply;  // cached body after the header block, see reply_caches
+  uint8_t reply_copy;        // copy of reply_caches it points into
+  cec_tx_done_t done;
+  void *ctx;
+  bool timed;              // reply to a received request, record the latency
+  uint8_t request_opcode;  // opcode of the request
+  uint64_t request_end;    // end of the request frame
+} cec_tx_request_t;
+
+/* The request being handled by cec_task, replies are timed against it. */
+static struct {
+  bool valid;
+  uint8_t opcode;
+  uint64_t end;
+} reply_to;
+
+/* Upper bound of each latency bucket, the last bucket catches the rest. */
+const uint16_t cec_latency_bucket_ms[CEC_LATENCY_BUCKETS] = {1,  2,   5,   10,  20,
+                                                             50, 100, 200, 500, UINT16_MAX};
+
+static cec_latency_stats_t latency_stats;
+
+static QueueHandle_t tx_queue[CEC_TX_PRIORITY_COUNT];
+
 /**
  * Get milliseconds since boot.
  */
@@ -162,293 +278,1319 @@ uint64_t cec_get_uptime_ms(void) {
   return (time_us_64() / 1000);
 }
 
-/**
- * Log a timestamped formatted message.
- */
-__attribute__((format(printf, 5, 6))) static void log_printf(uint8_t initiator,
-                                                             uint8_t destination,
-                                                             bool send,
-                                                             bool ack,
-                                                             const char *fmt,
-                                                             ...) {
-  char prefix[64];
-  char buffer[64];
-  char *arrow = "??";
+static void decode_feature_abort(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  const char *reason = "Unknown reason";
 
-  if (send) {
-    if (ack) {
-      arrow = "->";
-    } else {
-      arrow = "~>";
-    }
+  if (pld[3] < (sizeof(cec_feature_abort_reason) / sizeof(cec_feature_abort_reason[0]))) {
+    reason = cec_feature_abort_reason[pld[3]];
+  }
+  snprintf(buf, size, "[%x][%s]", pld[2], reason);
+}
+
+static void decode_standby(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  snprintf(buf, size, "[%s]", "Display OFF");
+}
+
+static void decode_routing_change(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  snprintf(buf, size, "[%02x%02x -> %02x%02x]", pld[2], pld[3], pld[4], pld[5]);
+}
+
+static void decode_active_source(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  snprintf(buf, size, "[%02x%02x Display ON]", pld[2], pld[3]);
+}
+
+static void decode_physical_address(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  snprintf(buf, size, " %02x%02x", pld[2], pld[3]);
+}
+
+static void decode_user_control(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  uint8_t key = pld[2];
+  const char *name = (key < UINT8_MAX) ? cec_user_control_name[key] : NULL;
+
+  if (name != NULL) {
+    snprintf(buf, size, "[%s]", name);
   } else {
-    if (ack) {
-      arrow = "<-";
-    } else {
-      arrow = "<~";
-    }
+    snprintf(buf, size, " Unknown command: 0x%02x", key);
+  }
+}
+
+static void decode_power_status(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  const char *status = "unknown";
+
+  switch (pld[2]) {
+    case 0x00:
+      status = "On";
+      break;
+    case 0x01:
+      status = "Standby";
+      break;
+    case 0x02:
+      status = "In transition Standby to On";
+      break;
+    case 0x03:
+      status = "In transition On to Standby";
+      break;
   }
+  snprintf(buf, size, "[%s]", status);
+}
 
-  va_list ap;
-  va_start(ap, fmt);
-  snprintf(prefix, sizeof(prefix), "[%10llu] %02x %s %02x", cec_get_uptime_ms(),
-           send ? initiator : destination, arrow, send ? destination : initiator);
-  vsnprintf(buffer, sizeof(buffer), fmt, ap);
-  cec_log_submitf("%s: %s"_CDC_BR, prefix, buffer);
-  va_end(ap);
+static void decode_operands(const uint8_t *pld, uint8_t pldcnt, char *buf, size_t size) {
+  size_t n = 0;
+
+  buf[0] = '\0';
+  for (unsigned int i = 2; (i < pldcnt) && (n < size); i++) {
+    n += snprintf(&buf[n], size - n, " %02x", pld[i]);
+  }
 }
 
 /**
- * Log a CEC frame.
+ * Format a logged CEC frame, called from the log task.
  *
- * CEC frame logging function, which includes minor protocol decoding for debug
- * purposes.
+ * Includes minor protocol decoding for debug purposes. Operands are only
+ * decoded when the frame is long enough.
+ */
+static void format_cec_frame(const cec_log_frame_t *record, char *buf, size_t size) {
+  const uint8_t *data = record->data;
+  bool recv = (record->flags & CEC_LOG_FRAME_RECV) != 0;
+  bool ack = (record->flags & CEC_LOG_FRAME_ACK) != 0;
+  uint8_t initiator = (data[0] & 0xf0) >> 4;
+  uint8_t destination = data[0] & 0x0f;
+  char operands[48] = "";
+  const char *name = "Polling Message";
+
+  if (record->len > 1) {
+    const cec_opcode_t *op = &cec_opcode[data[1]];
+
+    name = op->name;
+    if (op->name == NULL) {
+      snprintf(operands, sizeof(operands), "[%x] (undecoded)", data[1]);
+    } else if (record->len < (2 + op->operands)) {
+      snprintf(operands, sizeof(operands), " (truncated)");
+    } else if (op->decode != NULL) {
+      op->decode(data, record->len, operands, sizeof(operands));
+    }
+  }
+
+  // received frames are listed initiator first
+  snprintf(buf, size, "[%10llu] %02x %s %02x: %s%s%s%s"_CDC_BR, record->timestamp / 1000,
+           recv ? initiator : destination, recv ? (ack ? "->" : "~>") : (ack ? "<-" : "<~"),
+           recv ? destination : initiator, (name != NULL) ? "[" : "", (name != NULL) ? name : "",
+           (name != NULL) ? "]" : "", operands);
+}
+
+/**
+ * Log a CEC frame, formatting is left to the log task.
  */
 static void log_cec_frame(hdmi_frame_t *frame, bool recv) {
   hdmi_message_t *msg = frame->message;
-  uint8_t initiator = (msg->data[0] & 0xf0) >> 4;
-  uint8_t destination = msg->data[0] & 0x0f;
-
-  if (msg->len > 1) {
-    uint8_t cmd = msg->data[1];
-    switch (cmd) {
-      case CEC_ID_FEATURE_ABORT:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%x][%s]", cec_message[cmd],
-                   msg->data[2], cec_feature_abort_reason[msg->data[3]]);
-        break;
-      case CEC_ID_STANDBY:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd],
-                   "Display OFF");
-        break;
-      case CEC_ID_ROUTING_CHANGE:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%02x%02x -> %02x%02x]",
-                   cec_message[cmd], msg->data[2], msg->data[3], msg->data[4], msg->data[5]);
-        break;
-      case CEC_ID_ACTIVE_SOURCE:
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%02x%02x Display ON]",
-                   cec_message[cmd], msg->data[2], msg->data[3]);
-        break;
-      case CEC_ID_REPORT_PHYSICAL_ADDRESS:
-        log_printf(initiator, destination, recv, frame->ack, "[%s] %02x%02x", cec_message[cmd],
-                   msg->data[2], msg->data[3]);
-        break;
-      case CEC_ID_USER_CONTROL_PRESSED: {
-        uint8_t key = msg->data[2];
-        const char *name = cec_user_control_name[key];
-        if (name != NULL) {
-          log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd], name);
-        } else {
-          log_printf(initiator, destination, recv, frame->ack, "[%s] Unknown command: 0x%02x",
-                     cec_message[cmd], key);
-        }
-      } break;
-      case CEC_ID_VENDOR_COMMAND_WITH_ID:
-        log_printf(initiator, destination, recv, frame->ack, "[%s]", cec_message[cmd]);
-        for (int i = 0; i < msg->len; i++) {
-          cec_log_submitf(" %02x"_CDC_BR, msg->data[i]);
-        }
-        break;
-      case CEC_ID_REPORT_POWER_STATUS:
-        const char *status = "unknown";
-        switch (msg->data[2]) {
-          case 0x00:
-            status = "On";
-            break;
-          case 0x01:
-            status = "Standby";
-            break;
-          case 0x02:
-            status = "In transition Standby to On";
-            break;
-          case 0x03:
-            status = "In transition On to Standby";
-            break;
-        }
-        log_printf(initiator, destination, recv, frame->ack, "[%s][%s]", cec_message[cmd], status);
-        break;
-      default: {
-        const char *message = cec_message[cmd];
-        if (strlen(message) > 0) {
-          log_printf(initiator, destination, recv, frame->ack, "[%s]", cec_message[cmd]);
-        } else {
-          log_printf(initiator, destination, recv, frame->ack, "[%x] (undecoded)", cmd);
-        }
-      }
-    }
-  } else {
-    log_printf(initiator, destination, recv, frame->ack, "[%s]", "Polling Message");
+
+  if (!CEC_LOG_ON(CEC_LOG_LEVEL_INFO, CEC_LOG_PROTO)) {
+    return;
   }
+  cec_log_frame(recv ? CEC_LOG_RING_RX : CEC_LOG_RING_TX, frame->timestamp, msg->data, msg->len,
+                (recv ? CEC_LOG_FRAME_RECV : 0) | (frame->ack ? CEC_LOG_FRAME_ACK : 0));
 }
 
+#if CEC_PHY_GPIO
 /**
  * Calculate next offset as time since boot.
  */
 static uint64_t time_next(uint64_t start, uint64_t next) {
   return (next - (time_us_64() - start));
 }
+#endif
+
+/* Number of received frames buffered between the ISR and cec_task. */
+#define RX_RING_SIZE 4
+
+/* Sum of one bit timing measurement, for calibration. */
+typedef struct {
+  uint32_t n;
+  uint32_t sum;
+  uint64_t sum_sq;
+} rx_sum_t;
+
+/* Bit timing measurements calibrated per initiator. */
+typedef struct {
+  rx_sum_t start_low;
+  rx_sum_t start_period;
+  rx_sum_t bit_period;
+  rx_sum_t one_low;
+  rx_sum_t zero_low;
+} rx_sums_t;
+
+typedef struct {
+  hdmi_frame_t frame;
+  hdmi_message_t message;
+  uint8_t data[16];
+  rx_sums_t sums;  // accepted bits of the frame
+} hdmi_rx_slot_t;
+
+/**
+ * Received frames, written by the ISR at rx_head and consumed by cec_task at
+ * rx_tail. The extra slot receives frames while the ring is full, these are
+ * counted and dropped.
+ */
+static hdmi_rx_slot_t rx_ring[RX_RING_SIZE + 1];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+
+/* Frame being received by the ISR. */
+static hdmi_frame_t *rx_frame = &rx_ring[RX_RING_SIZE].frame;
+static rx_sums_t *rx_sums = &rx_ring[RX_RING_SIZE].sums;
+
+/* Set while transmitting, frames seen by the receiver are our own. */
+static volatile bool tx_active = false;
+
+/* Start bit and final ACK times of the last frame sent. */
+static uint64_t tx_last_timestamp = 0;
+static uint64_t tx_last_end = 0;
+
+/* Time of the last edge (or PIO block) seen on the bus. */
+static volatile uint32_t bus_last_activity = 0;
+
+/* The last frame on the bus was sent by us. */
+static volatile bool bus_last_tx = false;
+
+/* Receive acceptance windows, from the configuration. */
+static cec_config_rx_timing_t rx_timing;
+
+/* Receive windows calibrated for each initiator, updated by cec_task. */
+static cec_config_rx_timing_t rx_peer_timing[16];
+
+/* Windows of the frame being received, the initiator's once it is known. */
+static const cec_config_rx_timing_t *rx_frame_timing = &rx_timing;
+
+/* Start bit windows of every initiator combined, checked before it is known. */
+static cec_config_window_t rx_start_low;
+static cec_config_window_t rx_start_period;
+
+/* Class of a bit low time, in order of length. */
+typedef enum {
+  RX_LOW_GLITCH = 0,  // noise
+  RX_LOW_SHORT = 1,   // below the logical 1 window
+  RX_LOW_ONE = 2,
+  RX_LOW_GAP = 3,  // between the logical 1 and 0 windows
+  RX_LOW_ZERO = 4,
+  RX_LOW_LONG = 5,   // above the logical 0 window
+  RX_LOW_START = 6,  // a start bit
+  RX_LOW_OVER = 7,   // above the start bit window
+} rx_low_t;
+
+/* A low time is in the first class it is below the bound of, or RX_LOW_OVER. */
+typedef struct {
+  uint32_t below[RX_LOW_OVER];
+} rx_low_table_t;
+
+/* Low time classes of the configured and calibrated windows, updated by cec_task. */
+static rx_low_table_t rx_low;
+static rx_low_table_t rx_peer_low[16];
+
+/* Low time classes of the frame being received. */
+static const rx_low_table_t *rx_frame_low = &rx_low;
+
+/* Receive timing histograms and window failures, written by the ISR. */
+static cec_rx_timing_stats_t rx_timing_stats;
+
+/* Lower bound of each receive timing histogram, 800 us below nominal. */
+const uint16_t cec_rx_hist_base_us[CEC_RX_MEASURE_COUNT] = {
+    [CEC_RX_MEASURE_START_LOW] = 2900, [CEC_RX_MEASURE_START_PERIOD] = 3700,
+    [CEC_RX_MEASURE_BIT_LOW] = 200,    [CEC_RX_MEASURE_BIT_PERIOD] = 1600,
+    [CEC_RX_MEASURE_ACK_LOW] = 200,
+};
+
+/**
+ * Build the low time classes of a set of windows, start bits are matched
+ * against the combined start bit window.
+ */
+static void rx_low_table(rx_low_table_t *table, const cec_config_rx_timing_t *timing) {
+  table->below[RX_LOW_GLITCH] = CEC_RX_GLITCH_US;
+  table->below[RX_LOW_SHORT] = timing->one_low.min;
+  table->below[RX_LOW_ONE] = timing->one_low.max + 1;
+  table->below[RX_LOW_GAP] = timing->zero_low.min;
+  table->below[RX_LOW_ZERO] = timing->zero_low.max + 1;
+  table->below[RX_LOW_LONG] = rx_start_low.min;
+  table->below[RX_LOW_START] = rx_start_low.max + 1;
+}
+
+#if CEC_PHY_GPIO
+/* Bus idle time ending the remains of an aborted frame. */
+#define CEC_RX_HUNT_IDLE_US (5000)
+
+/* ACK bit low time when we acknowledge a block. */
+#define CEC_RX_ACK_US (1500)
+
+/* Position of CEC_PIN's events in the GPIO interrupt registers. */
+#define RX_IRQ_SHIFT (4 * (CEC_PIN % 8))
+#define RX_IRQ_EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
+
+/* Window failure bound of each low time class. */
+static const uint8_t rx_low_bound[] = {
+    [RX_LOW_GLITCH] = CEC_RX_BOUND_SHORT, [RX_LOW_SHORT] = CEC_RX_BOUND_SHORT,
+    [RX_LOW_GAP] = CEC_RX_BOUND_GAP,      [RX_LOW_LONG] = CEC_RX_BOUND_LONG,
+    [RX_LOW_START] = CEC_RX_BOUND_LONG,   [RX_LOW_OVER] = CEC_RX_BOUND_LONG,
+};
+
+/* Edge interrupt enables of CEC_PIN on the core taking the interrupt. */
+static io_rw_32 *rx_irq_inte;
+
+/* Hardware alarm releasing the ACK, claimed by the receiver. */
+static uint rx_ack_alarm;
+
+/* Time of the edge that started the measurement in progress. */
+static uint32_t rx_edge;
+
+/* After an abort, start bits failing their window are the rest of that frame. */
+static bool rx_hunting = false;
+
+/* A measurement below its window, settled by the next edge. */
+static struct {
+  hdmi_frame_state_t state;  // state to return to if the pulse was a glitch
+  uint32_t edge;             // edge that state waits for
+  uint32_t time;             // edge that started the pulse
+  hdmi_frame_abort_t abort;  // otherwise abort the frame with this
+  cec_rx_measure_t measure;
+} rx_glitch;
+
+/**
+ * Wait for the next edge, clearing a stale event as gpio_set_irq_enabled()
+ * does. Both edge enables are written at once.
+ */
+static inline void hdmi_rx_arm(uint32_t edge) {
+  gpio_acknowledge_irq(CEC_PIN, edge);
+  hw_write_masked(rx_irq_inte, edge << RX_IRQ_SHIFT, RX_IRQ_EDGES << RX_IRQ_SHIFT);
+}
 
 /**
- * Pull the CEC line high at the specified time.
+ * Release the ACK, the alarm interrupt handler.
  */
-static int64_t ack_high(alarm_id_t alarm, void *user_data) {
+static void __time_critical_func(hdmi_rx_ack_release)(void) {
+  uint32_t begin = cec_profile_begin();
+
+  hw_clear_bits(&timer_hw->intr, 1u << rx_ack_alarm);
   gpio_set_dir(CEC_PIN, GPIO_IN);
+  cec_profile_end(CEC_PROFILE_ACK_RELEASE, begin);
+}
 
-  return 0;
+/**
+ * Pull the line low for an ACK, released by the alarm CEC_RX_ACK_US after the
+ * falling edge. begin is the profile start of the edge interrupt.
+ */
+static inline void hdmi_rx_ack(uint32_t fall, uint32_t begin) {
+  uint32_t release = fall + CEC_RX_ACK_US;
+
+  gpio_set_dir(CEC_PIN, GPIO_OUT);
+  cec_profile_end(CEC_PROFILE_ACK_DRIVE, begin);
+  // writing the target arms the alarm, it only compares the low 32 bits
+  timer_hw->alarm[rx_ack_alarm] = release;
+  if (((int32_t)(time_us_32() - release) >= 0) && (timer_hw->armed & (1u << rx_ack_alarm))) {
+    // already late, the alarm would not fire until the timer wraps
+    timer_hw->armed = 1u << rx_ack_alarm;
+    gpio_set_dir(CEC_PIN, GPIO_IN);
+  }
 }
 
-uint8_t rx_buffer[16] = {0x0};
-hdmi_message_t rx_message = {.data = &rx_buffer[0], .len = 0};
-hdmi_frame_t rx_frame = {.message = &rx_message};
+/**
+ * Add a measurement to its histogram.
+ */
+static inline void rx_timing_record(cec_rx_measure_t measure, uint32_t us) {
+  uint32_t base = cec_rx_hist_base_us[measure];
+  uint32_t offset = MIN((us > base) ? (us - base) : 0, CEC_RX_HIST_BUCKETS * CEC_RX_HIST_US);
+
+  // offset / CEC_RX_HIST_US, exact over the clamped range without a divide
+  rx_timing_stats.hist[measure][MIN((offset * 5243) >> 19, CEC_RX_HIST_BUCKETS - 1)]++;
+}
 
-static void hdmi_rx_frame_isr(uint gpio, uint32_t events) {
-  uint64_t low_time = 0;
-  gpio_acknowledge_irq(gpio, events);
-  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
-  // printf("state = %d, byte = %d, bit = %d\n", rx_frame.state, rx_frame.byte, rx_frame.bit);
-  switch (rx_frame.state) {
+static inline rx_low_t rx_low_classify(const rx_low_table_t *table, uint32_t us) {
+  rx_low_t low = RX_LOW_GLITCH;
+
+  while ((low < RX_LOW_OVER) && (us >= table->below[low])) {
+    low++;
+  }
+
+  return low;
+}
+
+static inline void rx_sum_add(rx_sum_t *sum, uint32_t us) {
+  sum->n++;
+  sum->sum += us;
+  sum->sum_sq += (uint64_t)us * us;
+}
+#endif
+
+/**
+ * Begin receiving a frame into the next free ring slot.
+ */
+static void hdmi_rx_frame_begin(uint32_t now) {
+  uint32_t head = rx_head;
+  uint32_t slot = ((head - rx_tail) < RX_RING_SIZE) ? (head % RX_RING_SIZE) : RX_RING_SIZE;
+  uint64_t boot = time_us_64();
+
+  rx_frame = &rx_ring[slot].frame;
+  rx_sums = &rx_ring[slot].sums;
+  if (slot == RX_RING_SIZE) {
+    // ring slots come back cleared from cec_task, the overflow slot never does
+    memset(rx_sums, 0, sizeof(*rx_sums));
+  }
+  rx_frame_timing = &rx_timing;
+  rx_frame_low = &rx_low;
+  // once per frame, the edges themselves are timed in 32 bits
+  rx_frame->timestamp = boot - (uint32_t)((uint32_t)boot - now);
+  rx_frame->start = rx_frame->timestamp;
+  rx_frame->bit = 0;
+  rx_frame->byte = 0;
+  rx_frame->first = true;
+  rx_frame->eom = false;
+  rx_frame->ack = false;
+  rx_frame->loopback = tx_active;
+  rx_frame->addresses = laddr_mask;
+  rx_frame->abort = HDMI_FRAME_ABORT_NONE;
+  rx_frame->message->len = 0;
+}
+
+/**
+ * Hand the received frame to cec_task and wait for the next frame.
+ */
+static void hdmi_rx_frame_end(uint32_t now, hdmi_frame_state_t state, hdmi_frame_abort_t abort) {
+  rx_frame->message->len = rx_frame->byte;
+  rx_frame->end = rx_frame->timestamp + (uint32_t)(now - (uint32_t)rx_frame->timestamp);
+  rx_frame->abort = abort;
+  rx_frame->state = state;
+
+  if (!rx_frame->loopback) {
+    bus_last_tx = false;
+  }
+
+  if (cec_monitor_active) {
+    cec_monitor_capture(rx_frame->timestamp, rx_frame->end, rx_frame->message->data,
+                        rx_frame->message->len,
+                        (rx_frame->ack ? CEC_TRACE_FLAG_ACK : 0)
+                            | (rx_frame->eom ? CEC_TRACE_FLAG_EOM : 0)
+                            | (rx_frame->loopback ? CEC_TRACE_FLAG_TX : 0),
+                        abort);
+  }
+  if (cec_capture_active && (abort != HDMI_FRAME_ABORT_NONE)) {
+    cec_capture_trigger(now);
+  }
+
+  if (rx_frame == &rx_ring[RX_RING_SIZE].frame) {
+    cec_stats.rx_dropped_frames++;
+  } else {
+    // publish the slot only once it is complete
+    __dmb();
+    rx_head++;
+    vTaskNotifyGiveIndexedFromISR(xCECTask, NOTIFY_RX, NULL);
+  }
+
+  rx_frame = &rx_ring[RX_RING_SIZE].frame;
+  rx_frame->state = HDMI_FRAME_STATE_START_LOW;
+}
+
+#if CEC_PHY_GPIO
+/**
+ * Abort the frame, counting the measurement and window bound that failed.
+ */
+static void hdmi_rx_frame_abort(uint32_t now,
+                                hdmi_frame_abort_t abort,
+                                cec_rx_measure_t measure,
+                                cec_rx_bound_t bound) {
+  rx_timing_stats.abort[measure][bound]++;
+  hdmi_rx_frame_end(now, HDMI_FRAME_STATE_ABORT, abort);
+  rx_hunting = true;
+}
+
+/**
+ * Hunt for the next start bit once a frame has been aborted, a falling edge
+ * that aborted a frame may be the start bit itself.
+ */
+static void hdmi_rx_hunt(uint32_t now, bool falling) {
+  if (falling && (rx_frame->state == HDMI_FRAME_STATE_START_LOW)) {
+    hdmi_rx_frame_begin(now);
+    rx_edge = now;
+    rx_frame->state = HDMI_FRAME_STATE_START_HIGH;
+    hdmi_rx_arm(GPIO_IRQ_EDGE_RISE);
+  } else {
+    hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+  }
+}
+
+/**
+ * Hold a measurement that fell short of its window until the next edge, it is
+ * a glitch if that edge follows within CEC_RX_GLITCH_US.
+ */
+static void hdmi_rx_glitch(uint32_t now,
+                           uint32_t edge,
+                           hdmi_frame_abort_t abort,
+                           cec_rx_measure_t measure) {
+  rx_glitch.state = rx_frame->state;
+  rx_glitch.edge = edge;
+  rx_glitch.time = now;
+  rx_glitch.abort = abort;
+  rx_glitch.measure = measure;
+  rx_frame->state = HDMI_FRAME_STATE_GLITCH;
+  hdmi_rx_arm(edge ^ RX_IRQ_EDGES);
+}
+
+/**
+ * A start bit low time seen mid-frame, end the frame and receive the new one.
+ */
+static void hdmi_rx_resync(uint32_t now, uint32_t low_time) {
+  hdmi_rx_frame_end(now, HDMI_FRAME_STATE_ABORT, HDMI_FRAME_ABORT_RESYNC);
+  hdmi_rx_frame_begin(rx_edge);
+  rx_sum_add(&rx_sums->start_low, low_time);
+  rx_timing_stats.resyncs++;
+  rx_hunting = false;
+  rx_frame->state = HDMI_FRAME_STATE_DATA_LOW;
+  hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+}
+
+/**
+ * The initiator is known, use the windows calibrated for it and check the
+ * start bit against them. Aborts the frame if the start bit fails.
+ */
+static bool hdmi_rx_peer_start(uint32_t now, uint8_t initiator) {
+  rx_frame_timing = &rx_peer_timing[initiator];
+  rx_frame_low = &rx_peer_low[initiator];
+
+  // the start bit has been measured once, so the sums hold it
+  uint32_t low = rx_sums->start_low.sum;
+  uint32_t period = rx_sums->start_period.sum;
+  const cec_config_window_t *window = &rx_frame_timing->start_low;
+  cec_rx_measure_t measure = CEC_RX_MEASURE_START_LOW;
+  uint32_t us = low;
+
+  if ((low >= window->min) && (low <= window->max)) {
+    window = &rx_frame_timing->start_period;
+    measure = CEC_RX_MEASURE_START_PERIOD;
+    us = period;
+    if ((period >= window->min) && (period <= window->max)) {
+      return true;
+    }
+  }
+
+  hdmi_rx_frame_abort(now, HDMI_FRAME_ABORT_START, measure,
+                      (us < window->min) ? CEC_RX_BOUND_SHORT : CEC_RX_BOUND_LONG);
+  return false;
+}
+
+/**
+ * Advance the receive state machine on an edge.
+ *
+ * Every path arms exactly one edge for the next interrupt.
+ */
+static inline void hdmi_rx_edge(uint32_t now, uint32_t begin) {
+  uint32_t idle = now - bus_last_activity;
+  uint32_t us = now - rx_edge;
+
+  bus_last_activity = now;
+  switch (rx_frame->state) {
     case HDMI_FRAME_STATE_START_LOW:
-      rx_frame.start = time_us_64();
-      rx_frame.state = HDMI_FRAME_STATE_START_HIGH;
-      gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE, true);
+      if (idle > CEC_RX_HUNT_IDLE_US) {
+        rx_hunting = false;
+      }
+      hdmi_rx_frame_begin(now);
+      rx_edge = now;
+      rx_frame->state = HDMI_FRAME_STATE_START_HIGH;
+      hdmi_rx_arm(GPIO_IRQ_EDGE_RISE);
       return;
-    case HDMI_FRAME_STATE_START_HIGH:
-      low_time = time_us_64() - rx_frame.start;
-      if (low_time >= 3500 && low_time <= 3900) {
-        rx_frame.first = true;
-        rx_frame.byte = 0;
-        rx_frame.bit = 0;
-        rx_frame.state = HDMI_FRAME_STATE_DATA_LOW;
-        gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_FALL, true);
+    case HDMI_FRAME_STATE_START_HIGH: {
+      rx_low_t low = rx_low_classify(rx_frame_low, us);
+      if (low == RX_LOW_GLITCH) {
+        // a spike on the idle bus
+        rx_timing_stats.glitches++;
+        rx_frame->state = HDMI_FRAME_STATE_START_LOW;
+        hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+        return;
+      }
+      rx_timing_record(CEC_RX_MEASURE_START_LOW, us);
+      if (low == RX_LOW_START) {
+        if (rx_hunting) {
+          rx_timing_stats.resyncs++;
+          rx_hunting = false;
+        }
+        rx_sum_add(&rx_sums->start_low, us);
+        rx_frame->state = HDMI_FRAME_STATE_DATA_LOW;
+        hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+      } else if (rx_hunting) {
+        // the rest of an aborted frame, keep hunting quietly
+        rx_frame->state = HDMI_FRAME_STATE_START_LOW;
+        hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+      } else if (low < RX_LOW_START) {
+        hdmi_rx_glitch(now, GPIO_IRQ_EDGE_RISE, HDMI_FRAME_ABORT_START, CEC_RX_MEASURE_START_LOW);
       } else {
-        rx_frame.state = HDMI_FRAME_STATE_ABORT;
-        xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_RX, 0, eNoAction, NULL);
+        hdmi_rx_frame_abort(now, HDMI_FRAME_ABORT_START, CEC_RX_MEASURE_START_LOW,
+                            CEC_RX_BOUND_LONG);
+        hdmi_rx_hunt(now, false);
       }
+    }
       return;
     case HDMI_FRAME_STATE_EOM_LOW:
-      rx_frame.byte++;
-      rx_frame.bit = 0;
     case HDMI_FRAME_STATE_DATA_LOW: {
-      uint64_t min_time = rx_frame.first ? 4300 : 2050;
-      uint64_t max_time = rx_frame.first ? 4700 : 2750;
-      uint64_t bit_time = time_us_64() - rx_frame.start;
-      if (bit_time >= min_time && bit_time <= max_time) {
-        rx_frame.start = time_us_64();
-        if (rx_frame.state == HDMI_FRAME_STATE_EOM_LOW) {
-          rx_frame.state = HDMI_FRAME_STATE_EOM_HIGH;
-        } else {
-          rx_frame.state = HDMI_FRAME_STATE_DATA_HIGH;
-        }
-        rx_frame.first = false;
-        gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE, true);
+      // the whole bit, from the falling edge that started it
+      const cec_config_window_t *window =
+          rx_frame->first ? &rx_start_period : &rx_frame_timing->bit_period;
+      cec_rx_measure_t measure =
+          rx_frame->first ? CEC_RX_MEASURE_START_PERIOD : CEC_RX_MEASURE_BIT_PERIOD;
+      rx_timing_record(measure, us);
+      if (us < window->min) {
+        hdmi_rx_glitch(now, GPIO_IRQ_EDGE_FALL, HDMI_FRAME_ABORT_BIT_PERIOD, measure);
+        return;
+      }
+      if (us > window->max) {
+        hdmi_rx_frame_abort(now, HDMI_FRAME_ABORT_BIT_PERIOD, measure, CEC_RX_BOUND_LONG);
+        hdmi_rx_hunt(now, true);
+        return;
+      }
+      rx_sum_add(rx_frame->first ? &rx_sums->start_period : &rx_sums->bit_period, us);
+      rx_edge = now;
+      if (rx_frame->state == HDMI_FRAME_STATE_EOM_LOW) {
+        rx_frame->byte++;
+        rx_frame->bit = 0;
+        rx_frame->state = HDMI_FRAME_STATE_EOM_HIGH;
       } else {
-        rx_frame.state = HDMI_FRAME_STATE_ABORT;
-        xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_RX, 0, eNoAction, NULL);
+        rx_frame->state = HDMI_FRAME_STATE_DATA_HIGH;
       }
+      rx_frame->first = false;
+      hdmi_rx_arm(GPIO_IRQ_EDGE_RISE);
     }
       return;
     case HDMI_FRAME_STATE_EOM_HIGH:
-    case HDMI_FRAME_STATE_DATA_HIGH:
-      low_time = time_us_64() - rx_frame.start;
-      uint8_t bit = false;
-      if (low_time >= 400 && low_time <= 800) {
-        bit = true;
-      } else if (low_time >= 1300 && low_time <= 1700) {
-        bit = false;
-      } else {
-        rx_frame.state = HDMI_FRAME_STATE_ABORT;
-        xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_RX, 0, eNoAction, NULL);
+    case HDMI_FRAME_STATE_DATA_HIGH: {
+      rx_low_t low = rx_low_classify(rx_frame_low, us);
+      rx_timing_record(CEC_RX_MEASURE_BIT_LOW, us);
+      if ((low != RX_LOW_ONE) && (low != RX_LOW_ZERO)) {
+        if (low == RX_LOW_START) {
+          hdmi_rx_resync(now, us);
+        } else if (low <= RX_LOW_SHORT) {
+          hdmi_rx_glitch(now, GPIO_IRQ_EDGE_RISE, HDMI_FRAME_ABORT_BIT_LOW,
+                         CEC_RX_MEASURE_BIT_LOW);
+        } else {
+          hdmi_rx_frame_abort(now, HDMI_FRAME_ABORT_BIT_LOW, CEC_RX_MEASURE_BIT_LOW,
+                              rx_low_bound[low]);
+          hdmi_rx_hunt(now, false);
+        }
         return;
       }
-      if (rx_frame.state == HDMI_FRAME_STATE_EOM_HIGH) {
-        rx_frame.eom = bit;
-        rx_frame.state = HDMI_FRAME_STATE_ACK_LOW;
+      bool bit = (low == RX_LOW_ONE);
+      rx_sum_add(bit ? &rx_sums->one_low : &rx_sums->zero_low, us);
+      if (rx_frame->state == HDMI_FRAME_STATE_EOM_HIGH) {
+        rx_frame->eom = bit;
+        rx_frame->state = HDMI_FRAME_STATE_ACK_LOW;
       } else {
-        rx_frame.message->data[rx_frame.byte] <<= 1;
-        rx_frame.message->data[rx_frame.byte] |= bit ? 0x01 : 0x00;
-        rx_frame.bit++;
-        if (rx_frame.bit > 7) {
-          rx_frame.state = HDMI_FRAME_STATE_EOM_LOW;
-        } else {
-          rx_frame.state = HDMI_FRAME_STATE_DATA_LOW;
+        uint8_t *data = &rx_frame->message->data[rx_frame->byte];
+        *data = (*data << 1) | (bit ? 0x01 : 0x00);
+        rx_frame->bit++;
+        if ((rx_frame->byte == 0) && (rx_frame->bit == 4)
+            && !hdmi_rx_peer_start(now, *data & 0x0f)) {
+          hdmi_rx_hunt(now, false);
+          return;
         }
+        rx_frame->state =
+            (rx_frame->bit > 7) ? HDMI_FRAME_STATE_EOM_LOW : HDMI_FRAME_STATE_DATA_LOW;
       }
-      gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_FALL, true);
+      hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+    }
       return;
-    case HDMI_FRAME_STATE_ACK_LOW:
-      rx_frame.start = time_us_64();
-      // send ack by changing ack from 1 to 0
-      uint8_t tgt_addr = rx_frame.message->data[0] & 0x0f;
-      if ((tgt_addr != 0x0f) && (tgt_addr == rx_frame.address)) {
-        rx_frame.state = HDMI_FRAME_STATE_ACK_END;
-        gpio_set_dir(CEC_PIN, GPIO_OUT);  // pull low, then schedule pull high
-        add_alarm_at(from_us_since_boot(rx_frame.start + 1500), ack_high, NULL, true);
-        rx_frame.ack = true;
+    case HDMI_FRAME_STATE_ACK_LOW: {
+      rx_edge = now;
+      // send ack by changing ack from 1 to 0, never for our own frames
+      uint8_t tgt_addr = rx_frame->message->data[0] & 0x0f;
+      if (((rx_frame->addresses >> tgt_addr) & 1) && !rx_frame->loopback) {
+        hdmi_rx_ack(now, begin);
       }
-      rx_frame.state = HDMI_FRAME_STATE_ACK_HIGH;
-      gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE, true);
+      rx_frame->state = HDMI_FRAME_STATE_ACK_HIGH;
+      hdmi_rx_arm(GPIO_IRQ_EDGE_RISE);
+    }
       return;
-    case HDMI_FRAME_STATE_ACK_HIGH:
-      low_time = time_us_64() - rx_frame.start;
-      if ((low_time >= 400 && low_time <= 800) || (low_time >= 1300 && low_time <= 1700)) {
-        rx_frame.state = HDMI_FRAME_STATE_ACK_END;
+    case HDMI_FRAME_STATE_ACK_HIGH: {
+      // followers ACK against the configured windows, not the initiator's
+      rx_low_t low = rx_low_classify(&rx_low, us);
+      rx_timing_record(CEC_RX_MEASURE_ACK_LOW, us);
+      if ((low == RX_LOW_ONE) || (low == RX_LOW_ZERO)) {
+        // a block is acknowledged by holding the line low, as the PIO receiver reports it
+        bool ack = (low == RX_LOW_ZERO);
+        rx_frame->ack = (rx_frame->byte <= 1) ? ack : (rx_frame->ack && ack);
+      } else if (low == RX_LOW_START) {
+        hdmi_rx_resync(now, us);
+        return;
+      } else if (low <= RX_LOW_SHORT) {
+        hdmi_rx_glitch(now, GPIO_IRQ_EDGE_RISE, HDMI_FRAME_ABORT_ACK, CEC_RX_MEASURE_ACK_LOW);
+        return;
       } else {
-        rx_frame.state = HDMI_FRAME_STATE_ABORT;
-        xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_RX, 0, eNoAction, NULL);
+        hdmi_rx_frame_abort(now, HDMI_FRAME_ABORT_ACK, CEC_RX_MEASURE_ACK_LOW, rx_low_bound[low]);
+        hdmi_rx_hunt(now, false);
         return;
       }
-      // fall through
-    case HDMI_FRAME_STATE_ACK_END:
-      if (rx_frame.eom) {
-        rx_frame.state = HDMI_FRAME_STATE_END;
+      if (!rx_frame->eom && (rx_frame->byte >= 16)) {
+        // no room for another block, the rest of the frame is not a start bit
+        hdmi_rx_frame_end(now, HDMI_FRAME_STATE_ABORT, HDMI_FRAME_ABORT_OVERFLOW);
+        rx_hunting = true;
+      } else if (!rx_frame->eom) {
+        rx_frame->state = HDMI_FRAME_STATE_DATA_LOW;
       } else {
-        rx_frame.state = HDMI_FRAME_STATE_DATA_LOW;
-        gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_FALL, true);
-        return;
+        hdmi_rx_frame_end(now, HDMI_FRAME_STATE_END, HDMI_FRAME_ABORT_NONE);
+      }
+      hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
+    }
+      return;
+    case HDMI_FRAME_STATE_GLITCH:
+      if ((now - rx_glitch.time) < CEC_RX_GLITCH_US) {
+        // the pulse was noise, carry on as if it never happened
+        rx_timing_stats.glitches++;
+        rx_frame->state = rx_glitch.state;
+        hdmi_rx_arm(rx_glitch.edge);
+      } else {
+        hdmi_rx_frame_abort(now, rx_glitch.abort, rx_glitch.measure, CEC_RX_BOUND_SHORT);
+        hdmi_rx_hunt(now, rx_glitch.edge == GPIO_IRQ_EDGE_RISE);
       }
-      // finish receiving frame
+      return;
     case HDMI_FRAME_STATE_END:
     default:
-      rx_frame.message->len = rx_frame.byte;
-      xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_RX, 0, eNoAction, NULL);
+      hdmi_rx_frame_end(now, HDMI_FRAME_STATE_END, HDMI_FRAME_ABORT_NONE);
+      hdmi_rx_arm(GPIO_IRQ_EDGE_FALL);
   }
 }
 
-static uint8_t recv_frame(uint8_t *pld, uint8_t address) {
-  // printf("recv_frame\n");
-  rx_frame.address = address;
-  rx_frame.state = HDMI_FRAME_STATE_START_LOW;
-  rx_frame.ack = false;
-  memset(&rx_frame.message->data[0], 0, 16);
-  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_FALL, true);
-  ulTaskNotifyTakeIndexed(NOTIFY_RX, pdTRUE, portMAX_DELAY);
-  memcpy(pld, rx_frame.message->data, rx_frame.message->len);
-  // printf("high water mark = %lu\n", uxTaskGetStackHighWaterMark(xCECTask));
+/**
+ * Edge interrupt handler.
+ */
+static void __time_critical_func(hdmi_rx_frame_isr)(void) {
+  uint32_t now = time_us_32();
+  uint32_t begin = cec_profile_begin();
+  uint32_t events = gpio_get_irq_event_mask(CEC_PIN) & RX_IRQ_EDGES;
+
+  if (events == 0) {
+    // another pin on the shared bank interrupt
+    return;
+  }
+  gpio_acknowledge_irq(CEC_PIN, events);
+  if (cec_capture_active) {
+    cec_capture_edge(now, (events & GPIO_IRQ_EDGE_RISE) != 0);
+  }
+
+  hdmi_rx_edge(now, begin);
+  cec_profile_end(CEC_PROFILE_RX, begin);
+}
+#endif
+
+#if CEC_PHY_PIO
+/* PIO0 is taken by the WS2812 driver. */
+#define CEC_RX_PIO pio1
+#define CEC_RX_PIO_IRQ PIO1_IRQ_0
+
+static uint cec_rx_sm;
+static uint cec_rx_offset;
+
+/**
+ * Assemble the block words pushed by the PIO receiver into the receive frame.
+ *
+ * See hdmi-cec.pio for the block word format.
+ */
+static void hdmi_rx_pio_isr(void) {
+  uint32_t begin = cec_profile_begin();
+
+  while (!pio_sm_is_rx_fifo_empty(CEC_RX_PIO, cec_rx_sm)) {
+    uint32_t word = pio_sm_get(CEC_RX_PIO, cec_rx_sm);
+    bus_last_activity = time_us_32();
+
+    if (cec_rx_is_header(word)) {
+      if (rx_frame->state != HDMI_FRAME_STATE_START_LOW) {
+        // previous frame was cut short, the receiver resynchronised
+        hdmi_rx_frame_end(time_us_32(), HDMI_FRAME_STATE_ABORT, HDMI_FRAME_ABORT_RESYNC);
+      }
+      hdmi_rx_frame_begin(time_us_32());
+      // claim the frame, the PIO then drives the ACK for every block
+      uint8_t tgt_addr = cec_rx_data(word) & 0x0f;
+      pio_sm_put(CEC_RX_PIO, cec_rx_sm,
+                 ((rx_frame->addresses >> tgt_addr) & 1) && !rx_frame->loopback);
+      rx_frame->message->data[0] = cec_rx_data(word);
+      rx_frame->byte = 1;
+      rx_frame->ack = true;
+      rx_frame->eom = cec_rx_eom(word);
+      rx_frame->state = rx_frame->eom ? HDMI_FRAME_STATE_ACK_END : HDMI_FRAME_STATE_DATA_LOW;
+      continue;
+    }
+
+    if (rx_frame->state == HDMI_FRAME_STATE_START_LOW) {
+      // tail of a frame that started before the receiver was enabled
+      continue;
+    }
 
-  log_cec_frame(&rx_frame, true);
+    if (rx_frame->state == HDMI_FRAME_STATE_ACK_END) {
+      rx_frame->ack &= cec_rx_trailer_ack(word);
+      hdmi_rx_frame_end(time_us_32(), HDMI_FRAME_STATE_END, HDMI_FRAME_ABORT_NONE);
+      continue;
+    }
 
-  if (rx_frame.state == HDMI_FRAME_STATE_ABORT) {
-    // printf("ABORT\n");
-    cec_stats.rx_abort_frames++;
-    return 0;
+    rx_frame->ack &= cec_rx_block_ack(word);
+    if (rx_frame->byte >= 16) {
+      hdmi_rx_frame_end(time_us_32(), HDMI_FRAME_STATE_ABORT, HDMI_FRAME_ABORT_OVERFLOW);
+      continue;
+    }
+    rx_frame->message->data[rx_frame->byte++] = cec_rx_data(word);
+    rx_frame->eom = cec_rx_eom(word);
+    if (rx_frame->eom) {
+      rx_frame->state = HDMI_FRAME_STATE_ACK_END;
+    }
   }
+  cec_profile_end(CEC_PROFILE_RX, begin);
+}
+#endif
+
+#if CEC_PHY_PIO && CEC_MONITOR
+/**
+ * Feed the line edges to the capture, the PIO receiver does not see them.
+ */
+static void hdmi_rx_edge_isr(void) {
+  uint32_t events = gpio_get_irq_event_mask(CEC_PIN);
 
-  cec_stats.rx_frames++;
-  return rx_frame.message->len;
+  if ((events & (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)) == 0) {
+    return;
+  }
+  gpio_acknowledge_irq(CEC_PIN, events);
+
+  if (cec_capture_active) {
+    uint32_t now = time_us_32();
+    bool level = gpio_get(CEC_PIN);
+    if ((events & (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL))
+        == (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)) {
+      // a glitch shorter than the interrupt latency
+      cec_capture_edge(now, !level);
+    }
+    cec_capture_edge(now, level);
+  }
 }
+#endif
 
-static int64_t hdmi_tx_callback(alarm_id_t alarm, void *user_data) {
-  hdmi_frame_t *frame = (hdmi_frame_t *)user_data;
+/* Data bits of each measurement before an initiator's windows move. */
+#define RX_CAL_MIN_BITS (64)
 
-  uint64_t low_time = 0;
-  switch (frame->state) {
-    case HDMI_FRAME_STATE_START_LOW:
-      gpio_set_dir(CEC_PIN, GPIO_OUT);
-      frame->start = time_us_64();
-      frame->state = HDMI_FRAME_STATE_START_HIGH;
-      return time_next(frame->start, 3700);
-    case HDMI_FRAME_STATE_START_HIGH:
-      gpio_set_dir(CEC_PIN, GPIO_IN);
-      frame->state = HDMI_FRAME_STATE_DATA_LOW;
+/* Start bits before an initiator's start bit windows move. */
+#define RX_CAL_MIN_FRAMES (16)
+
+/* History is halved past this many samples, so calibration follows drift. */
+#define RX_CAL_DECAY_BITS (1024)
+
+/* Windows stop following initiators with noisier timing than this. */
+#define RX_CAL_MAX_STDDEV_US (100)
+
+/* Furthest a calibrated window moves from the configured one. */
+#define RX_CAL_MAX_SHIFT_US (150)
+
+/* Save the shifts once one has moved this far from the saved value. */
+#define RX_CAL_SAVE_US (50)
+
+/* Bit timing learnt per initiator, only used by cec_task. */
+static rx_sums_t rx_cal[16];
+
+/* Window shifts as last saved to NVS. */
+static cec_config_rx_offset_t rx_offset_saved[16];
+
+static uint32_t isqrt(uint64_t x) {
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= (root + bit)) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return (uint32_t)root;
+}
+
+static uint64_t rx_cal_variance(const rx_sum_t *cal) {
+  // exact, a truncated mean squared is out by thousands at start bit lengths
+  uint64_t n_sum_sq = (uint64_t)cal->n * cal->sum_sq;
+  uint64_t sum_2 = (uint64_t)cal->sum * cal->sum;
+
+  return (n_sum_sq > sum_2) ? ((n_sum_sq - sum_2) / ((uint64_t)cal->n * cal->n)) : 0;
+}
+
+/**
+ * Add the bits of a frame to an initiator's history.
+ */
+static void rx_cal_add(rx_sum_t *cal, const rx_sum_t *frame) {
+  if ((cal->n + frame->n) > RX_CAL_DECAY_BITS) {
+    // scale the sums by exactly what n loses, or the variance goes negative
+    uint32_t n = cal->n / 2;
+    cal->sum = (uint32_t)(((uint64_t)cal->sum * n) / cal->n);
+    cal->sum_sq = (cal->sum_sq * n) / cal->n;
+    cal->n = n;
+  }
+  cal->n += frame->n;
+  cal->sum += frame->sum;
+  cal->sum_sq += frame->sum_sq;
+}
+
+/**
+ * Shift centring the window on the learnt mean, the current shift is kept
+ * until min samples have been seen.
+ */
+static int16_t rx_cal_offset(const rx_sum_t *cal,
+                             uint32_t min,
+                             const cec_config_window_t *window,
+                             int16_t offset) {
+  if (cal->n < min) {
+    return offset;
+  }
+  if (rx_cal_variance(cal) > (RX_CAL_MAX_STDDEV_US * RX_CAL_MAX_STDDEV_US)) {
+    // too noisy to say where the peer's clock is, leave the window be
+    return offset;
+  }
+
+  int32_t shift = (int32_t)(cal->sum / cal->n) - ((window->min + window->max) / 2);
+
+  return (int16_t)MAX(MIN(shift, RX_CAL_MAX_SHIFT_US), -RX_CAL_MAX_SHIFT_US);
+}
+
+/**
+ * Shift a window, keeping it within the specification's receiver window or
+ * the configured one where that is wider.
+ */
+static void rx_window_shift(cec_config_window_t *window,
+                            int16_t offset,
+                            const cec_config_window_t *spec) {
+  int32_t lo = MIN(window->min, spec->min);
+  int32_t hi = MAX(window->max, spec->max);
+
+  window->min = (uint16_t)MIN(MAX((int32_t)window->min + offset, lo), hi);
+  window->max = (uint16_t)MAX(MIN((int32_t)window->max + offset, hi), lo);
+}
+
+static void rx_window_union(cec_config_window_t *window, const cec_config_window_t *other) {
+  window->min = MIN(window->min, other->min);
+  window->max = MAX(window->max, other->max);
+}
+
+/**
+ * Apply an initiator's window shifts to the configured windows.
+ */
+static void rx_peer_windows(uint8_t initiator) {
+  const cec_config_rx_offset_t *offset = &config.rx_offset[initiator];
+  const cec_config_rx_timing_t *spec = &cec_config_spec_rx_timing;
+  cec_config_rx_timing_t timing = rx_timing;
+
+  rx_window_shift(&timing.start_low, offset->start_low, &spec->start_low);
+  rx_window_shift(&timing.start_period, offset->start_period, &spec->start_period);
+  rx_window_shift(&timing.bit_period, offset->bit_period, &spec->bit_period);
+  rx_window_shift(&timing.one_low, offset->one_low, &spec->one_low);
+  rx_window_shift(&timing.zero_low, offset->zero_low, &spec->zero_low);
+  if ((timing.one_low.max >= timing.zero_low.min)
+      || (timing.zero_low.max >= timing.start_low.min)
+      || (timing.bit_period.max >= timing.start_period.min)) {
+    // the shifted windows would be ambiguous
+    timing = rx_timing;
+  }
+
+  cec_config_window_t start_low = rx_timing.start_low;
+  cec_config_window_t start_period = rx_timing.start_period;
+  for (uint8_t i = 0; i < 16; i++) {
+    const cec_config_rx_timing_t *peer = (i == initiator) ? &timing : &rx_peer_timing[i];
+    rx_window_union(&start_low, &peer->start_low);
+    rx_window_union(&start_period, &peer->start_period);
+  }
+
+  taskENTER_CRITICAL();
+  rx_peer_timing[initiator] = timing;
+  rx_start_low = start_low;
+  rx_start_period = start_period;
+  // every table holds the combined start bit window
+  rx_low_table(&rx_low, &rx_timing);
+  for (uint8_t i = 0; i < 16; i++) {
+    rx_low_table(&rx_peer_low[i], &rx_peer_timing[i]);
+  }
+  taskEXIT_CRITICAL();
+}
+
+/**
+ * Learn the initiator's bit timing from a received frame and centre its
+ * windows on it.
+ */
+static void rx_calibrate(uint8_t initiator, const rx_sums_t *sums) {
+  rx_sums_t *cal = &rx_cal[initiator];
+  cec_config_rx_offset_t *offset = &config.rx_offset[initiator];
+  const cec_config_rx_offset_t *saved = &rx_offset_saved[initiator];
+
+  rx_cal_add(&cal->start_low, &sums->start_low);
+  rx_cal_add(&cal->start_period, &sums->start_period);
+  rx_cal_add(&cal->bit_period, &sums->bit_period);
+  rx_cal_add(&cal->one_low, &sums->one_low);
+  rx_cal_add(&cal->zero_low, &sums->zero_low);
+
+  cec_config_rx_offset_t next = {
+      .start_low = rx_cal_offset(&cal->start_low, RX_CAL_MIN_FRAMES, &rx_timing.start_low,
+                                 offset->start_low),
+      .start_period = rx_cal_offset(&cal->start_period, RX_CAL_MIN_FRAMES,
+                                    &rx_timing.start_period, offset->start_period),
+      .bit_period = rx_cal_offset(&cal->bit_period, RX_CAL_MIN_BITS, &rx_timing.bit_period,
+                                  offset->bit_period),
+      .one_low = rx_cal_offset(&cal->one_low, RX_CAL_MIN_BITS, &rx_timing.one_low,
+                               offset->one_low),
+      .zero_low = rx_cal_offset(&cal->zero_low, RX_CAL_MIN_BITS, &rx_timing.zero_low,
+                                offset->zero_low),
+  };
+  if (memcmp(&next, offset, sizeof(next)) == 0) {
+    return;
+  }
+  *offset = next;
+  rx_peer_windows(initiator);
+
+  if ((abs(next.start_low - saved->start_low) >= RX_CAL_SAVE_US)
+      || (abs(next.start_period - saved->start_period) >= RX_CAL_SAVE_US)
+      || (abs(next.bit_period - saved->bit_period) >= RX_CAL_SAVE_US)
+      || (abs(next.one_low - saved->one_low) >= RX_CAL_SAVE_US)
+      || (abs(next.zero_low - saved->zero_low) >= RX_CAL_SAVE_US)) {
+    // only save when a window has really moved, the NVS task writes once the bus is quiet
+    memcpy(rx_offset_saved, config.rx_offset, sizeof(rx_offset_saved));
+    nvs_request_save();
+  }
+}
+
+void cec_get_rx_peer_stats(uint8_t initiator, cec_rx_peer_stats_t *stats) {
+  rx_sums_t cal;
+  cec_config_rx_offset_t offset;
+
+  taskENTER_CRITICAL();
+  cal = rx_cal[initiator & 0x0f];
+  offset = config.rx_offset[initiator & 0x0f];
+  taskEXIT_CRITICAL();
+
+  memset(stats, 0, sizeof(*stats));
+  stats->frames = cal.start_low.n;
+  stats->bits = cal.bit_period.n;
+  if (cal.start_low.n > 0) {
+    stats->start_low_mean = cal.start_low.sum / cal.start_low.n;
+    stats->start_low_stddev = isqrt(rx_cal_variance(&cal.start_low));
+  }
+  if (cal.start_period.n > 0) {
+    stats->start_period_mean = cal.start_period.sum / cal.start_period.n;
+    stats->start_period_stddev = isqrt(rx_cal_variance(&cal.start_period));
+  }
+  if (cal.bit_period.n > 0) {
+    stats->bit_period_mean = cal.bit_period.sum / cal.bit_period.n;
+    stats->bit_period_stddev = isqrt(rx_cal_variance(&cal.bit_period));
+  }
+  if (cal.one_low.n > 0) {
+    stats->one_low_mean = cal.one_low.sum / cal.one_low.n;
+    stats->one_low_stddev = isqrt(rx_cal_variance(&cal.one_low));
+  }
+  if (cal.zero_low.n > 0) {
+    stats->zero_low_mean = cal.zero_low.sum / cal.zero_low.n;
+    stats->zero_low_stddev = isqrt(rx_cal_variance(&cal.zero_low));
+  }
+  stats->start_low_offset = offset.start_low;
+  stats->start_period_offset = offset.start_period;
+  stats->bit_period_offset = offset.bit_period;
+  stats->one_low_offset = offset.one_low;
+  stats->zero_low_offset = offset.zero_low;
+}
+
+/**
+ * Load the receive windows and shifts from the configuration, only called by
+ * cec_task. Timing learnt against other windows is discarded.
+ */
+static void rx_timing_load(void) {
+  if (memcmp(&rx_timing, &config.rx_timing, sizeof(rx_timing)) != 0) {
+    memset(rx_cal, 0, sizeof(rx_cal));
+  }
+  taskENTER_CRITICAL();
+  rx_timing = config.rx_timing;
+  taskEXIT_CRITICAL();
+  for (uint8_t i = 0; i < 16; i++) {
+    rx_offset_saved[i] = config.rx_offset[i];
+    rx_peer_windows(i);
+  }
+}
+
+/**
+ * Initialise the receiver, it then stays enabled.
+ */
+static void hdmi_rx_init(void) {
+  for (unsigned int i = 0; i < (RX_RING_SIZE + 1); i++) {
+    rx_ring[i].message.data = &rx_ring[i].data[0];
+    rx_ring[i].frame.message = &rx_ring[i].message;
+  }
+  rx_frame->state = HDMI_FRAME_STATE_START_LOW;
+  rx_timing_load();
+
+#if CEC_PHY_PIO
+  cec_rx_sm = pio_claim_unused_sm(CEC_RX_PIO, true);
+  cec_rx_offset = pio_add_program(CEC_RX_PIO, &cec_rx_program);
+  cec_rx_program_init(CEC_RX_PIO, cec_rx_sm, cec_rx_offset, CEC_PIN);
+
+  irq_set_exclusive_handler(CEC_RX_PIO_IRQ, &hdmi_rx_pio_isr);
+  pio_set_irq0_source_enabled(CEC_RX_PIO, pis_sm0_rx_fifo_not_empty + cec_rx_sm, true);
+  irq_set_enabled(CEC_RX_PIO_IRQ, true);
+#if CEC_MONITOR
+  // edge capture only, every edge interrupts
+  gpio_add_raw_irq_handler(CEC_PIN, &hdmi_rx_edge_isr);
+  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+#endif
+#else
+  rx_ack_alarm = hardware_alarm_claim_unused(true);
+  irq_set_exclusive_handler(TIMER_IRQ_0 + rx_ack_alarm, &hdmi_rx_ack_release);
+  hw_set_bits(&timer_hw->inte, 1u << rx_ack_alarm);
+  irq_set_enabled(TIMER_IRQ_0 + rx_ack_alarm, true);
+
+  // a raw handler skips the SDK's scan of every pin for the callback
+  rx_irq_inte = &((get_core_num() == 0) ? &io_bank0_hw->proc0_irq_ctrl
+                                        : &io_bank0_hw->proc1_irq_ctrl)
+                     ->inte[CEC_PIN / 8];
+  gpio_add_raw_irq_handler(CEC_PIN, &hdmi_rx_frame_isr);
+  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_FALL, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+#endif
+}
+
+/**
+ * Take the next received frame from the ring.
+ *
+ * The frame remains valid until the next call, when its slot is returned to
+ * the ISR. Our own transmitted frames and aborted frames are not returned.
+ * Returns NULL if no frame arrived within timeout, or the task was woken for
+ * other work.
+ */
+static hdmi_frame_t *recv_frame(TickType_t timeout) {
+  static bool held = false;
+
+  while (true) {
+    if (held) {
+      // cleared here rather than in the ISR, which only adds to it
+      memset(&rx_ring[rx_tail % RX_RING_SIZE].sums, 0, sizeof(rx_sums_t));
+      __dmb();
+      rx_tail++;
+      held = false;
+    }
+
+    if (rx_head == rx_tail) {
+      ulTaskNotifyTakeIndexed(NOTIFY_RX, pdTRUE, timeout);
+      if (rx_head == rx_tail) {
+        return NULL;
+      }
+    }
+
+    hdmi_frame_t *frame = &rx_ring[rx_tail % RX_RING_SIZE].frame;
+    held = true;
+    // printf("high water mark = %lu\n", uxTaskGetStackHighWaterMark(xCECTask));
+
+    if (frame->loopback) {
+      continue;
+    }
+
+    log_cec_frame(frame, true);
+
+    if (frame->state == HDMI_FRAME_STATE_ABORT) {
+      CEC_LOG_DEBUG(CEC_LOG_PHY, "Frame aborted in block %u, reason %u"_CDC_BR, frame->byte,
+                    frame->abort);
+      cec_stats.rx_abort_frames++;
+      continue;
+    }
+
+    cec_stats.rx_frames++;
+    rx_calibrate(frame->message->data[0] >> 4, &rx_ring[rx_tail % RX_RING_SIZE].sums);
+    return frame;
+  }
+}
+
+/* Attempts to send a frame when arbitration is lost. */
+#define TX_ARB_ATTEMPTS 5
+
+/* Retransmissions of a frame that was not acknowledged. */
+#define TX_RETRANSMITS 5
+
+/* Nominal data bit period. */
+#define CEC_BIT_PERIOD_US 2400
+
+/* Signal free time before sending, in bit periods. */
+#define SFT_RETRY 3
+#define SFT_NEW_INITIATOR 5
+#define SFT_NEXT_FRAME 7
+
+/**
+ * Abandon a frame after losing arbitration.
+ *
+ * Called from interrupt context, the receiver takes over the winning frame
+ * which may be addressed to us.
+ */
+static void hdmi_tx_arbitration_lost(hdmi_frame_t *frame, hdmi_frame_abort_t abort) {
+  frame->state = HDMI_FRAME_STATE_ABORT;
+  frame->abort = abort;
+  tx_active = false;
+  rx_frame->loopback = false;
+  vTaskNotifyGiveIndexedFromISR(xCECTxTask, NOTIFY_TX, NULL);
+}
+
+#if CEC_PHY_PIO
+/* PIO0 is shared with the WS2812 driver. */
+#define CEC_TX_PIO pio0
+#define CEC_TX_PIO_IRQ PIO0_IRQ_0
+#define CEC_TX_DMA_IRQ DMA_IRQ_0
+
+static uint cec_tx_sm;
+static uint cec_tx_offset;
+static uint cec_tx_dma_blocks;
+static uint cec_tx_dma_samples;
+
+/* Frame being sent by the PIO transmitter. */
+static hdmi_frame_t *tx_frame;
+
+/* Transmit block words, and the sampled word returned for each block. */
+static uint32_t tx_blocks[16];
+static uint32_t tx_samples[16];
+
+/**
+ * Sampled words for the whole frame have been received.
+ */
+static void hdmi_tx_dma_isr(void) {
+  uint32_t begin = cec_profile_begin();
+
+  if (dma_channel_get_irq0_status(cec_tx_dma_samples)) {
+    dma_channel_acknowledge_irq0(cec_tx_dma_samples);
+    tx_frame->end = time_us_64();
+    vTaskNotifyGiveIndexedFromISR(xCECTxTask, NOTIFY_TX, NULL);
+  }
+  cec_profile_end(CEC_PROFILE_TX_DMA, begin);
+}
+
+/**
+ * The transmitter stalled after losing arbitration.
+ *
+ * Drop the rest of the frame and restart the state machine, ready for the
+ * next frame.
+ */
+static void hdmi_tx_pio_isr(void) {
+  uint32_t begin = cec_profile_begin();
+
+  if (!pio_interrupt_get(CEC_TX_PIO, cec_tx_sm)) {
+    return;
+  }
+
+  // aborting may raise the completion interrupt (RP2040-E13)
+  dma_channel_set_irq0_enabled(cec_tx_dma_samples, false);
+  dma_channel_abort(cec_tx_dma_blocks);
+  dma_channel_abort(cec_tx_dma_samples);
+  dma_channel_acknowledge_irq0(cec_tx_dma_samples);
+  dma_channel_set_irq0_enabled(cec_tx_dma_samples, true);
+
+  pio_sm_clear_fifos(CEC_TX_PIO, cec_tx_sm);
+  pio_sm_restart(CEC_TX_PIO, cec_tx_sm);
+  pio_sm_exec(CEC_TX_PIO, cec_tx_sm, pio_encode_jmp(cec_tx_offset + cec_tx_offset_start));
+  pio_interrupt_clear(CEC_TX_PIO, cec_tx_sm);
+
+  pio_gpio_init(CEC_RX_PIO, CEC_PIN);
+  hdmi_tx_arbitration_lost(tx_frame, HDMI_FRAME_ABORT_ARBITRATION);
+  cec_profile_end(CEC_PROFILE_TX, begin);
+}
+
+/**
+ * Initialise the PIO transmitter and its DMA channels.
+ */
+static void hdmi_tx_init(void) {
+  cec_tx_sm = pio_claim_unused_sm(CEC_TX_PIO, true);
+  cec_tx_offset = pio_add_program(CEC_TX_PIO, &cec_tx_program);
+  cec_tx_program_init(CEC_TX_PIO, cec_tx_sm, cec_tx_offset, CEC_PIN);
+
+  cec_tx_dma_blocks = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(cec_tx_dma_blocks);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, pio_get_dreq(CEC_TX_PIO, cec_tx_sm, true));
+  dma_channel_configure(cec_tx_dma_blocks, &c, &CEC_TX_PIO->txf[cec_tx_sm], tx_blocks, 0, false);
+
+  cec_tx_dma_samples = dma_claim_unused_channel(true);
+  c = dma_channel_get_default_config(cec_tx_dma_samples);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_dreq(&c, pio_get_dreq(CEC_TX_PIO, cec_tx_sm, false));
+  dma_channel_configure(cec_tx_dma_samples, &c, tx_samples, &CEC_TX_PIO->rxf[cec_tx_sm], 0,
+                        false);
+
+  irq_set_exclusive_handler(CEC_TX_DMA_IRQ, &hdmi_tx_dma_isr);
+  dma_channel_set_irq0_enabled(cec_tx_dma_samples, true);
+  irq_set_enabled(CEC_TX_DMA_IRQ, true);
+
+  irq_set_exclusive_handler(CEC_TX_PIO_IRQ, &hdmi_tx_pio_isr);
+  pio_set_irq0_source_enabled(CEC_TX_PIO, pis_interrupt0 + cec_tx_sm, true);
+  irq_set_enabled(CEC_TX_PIO_IRQ, true);
+}
+
+/**
+ * Send a frame with the PIO transmitter.
+ *
+ * Blocks are queued by DMA and the per block ACK samples are collected by DMA,
+ * the task is only woken once the whole frame has been sent.
+ */
+static void hdmi_tx_pio(hdmi_frame_t *frame) {
+  hdmi_message_t *msg = frame->message;
+
+  for (uint8_t i = 0; i < msg->len; i++) {
+    bool eom = (i + 1) == msg->len;
+    tx_blocks[i] = cec_tx_block(msg->data[i], eom, eom, i == 0);
+  }
+
+  if (!gpio_get(CEC_PIN)) {
+    // another initiator started first
+    frame->state = HDMI_FRAME_STATE_ABORT;
+    frame->abort = HDMI_FRAME_ABORT_BUSY;
+    return;
+  }
+
+  // hand the pin to the transmitter, the receiver keeps sampling
+  tx_frame = frame;
+  pio_gpio_init(CEC_TX_PIO, CEC_PIN);
+
+  frame->start = time_us_64();
+  frame->timestamp = frame->start;
+  dma_channel_set_write_addr(cec_tx_dma_samples, tx_samples, false);
+  dma_channel_set_trans_count(cec_tx_dma_samples, msg->len, true);
+  dma_channel_set_read_addr(cec_tx_dma_blocks, tx_blocks, false);
+  dma_channel_set_trans_count(cec_tx_dma_blocks, msg->len, true);
+  ulTaskNotifyTakeIndexed(NOTIFY_TX, pdTRUE, portMAX_DELAY);
+  pio_gpio_init(CEC_RX_PIO, CEC_PIN);
+
+  if (frame->state == HDMI_FRAME_STATE_ABORT) {
+    return;
+  }
+
+  frame->byte = msg->len;
+  frame->ack = true;
+  for (uint8_t i = 0; i < msg->len; i++) {
+    frame->ack &= cec_tx_ack(tx_samples[i]);
+  }
+  frame->state = HDMI_FRAME_STATE_END;
+}
+#else
+/**
+ * Drive the next edge of the frame, returns the alarm time of the edge after.
+ */
+static int64_t hdmi_tx_frame_step(hdmi_frame_t *frame) {
+  uint64_t low_time = 0;
+  switch (frame->state) {
+    case HDMI_FRAME_STATE_START_LOW:
+      if (!gpio_get(CEC_PIN)) {
+        // another initiator started first
+        hdmi_tx_arbitration_lost(frame, HDMI_FRAME_ABORT_BUSY);
+        return 0;
+      }
+      gpio_set_dir(CEC_PIN, GPIO_OUT);
+      frame->start = time_us_64();
+      frame->timestamp = frame->start;
+      frame->state = HDMI_FRAME_STATE_START_HIGH;
+      return time_next(frame->start, 3700);
+    case HDMI_FRAME_STATE_START_HIGH:
+      gpio_set_dir(CEC_PIN, GPIO_IN);
+      frame->state = HDMI_FRAME_STATE_DATA_LOW;
       return time_next(frame->start, 4500);
     case HDMI_FRAME_STATE_DATA_LOW:
       gpio_set_dir(CEC_PIN, GPIO_OUT);
@@ -458,6 +1600,19 @@ static int64_t hdmi_tx_callback(alarm_id_t alarm, void *user_data) {
       return time_next(frame->start, low_time);
     case HDMI_FRAME_STATE_DATA_HIGH:
       gpio_set_dir(CEC_PIN, GPIO_IN);
+      if ((frame->byte == 0) && (frame->bit >= 4) &&
+          (frame->message->data[0] & (1 << frame->bit))) {
+        // initiator address bit sent as a 1, check at the safe sample point
+        frame->state = HDMI_FRAME_STATE_ARBITRATE;
+        return time_next(frame->start, 1050);
+      }
+      // fall through
+    case HDMI_FRAME_STATE_ARBITRATE:
+      if ((frame->state == HDMI_FRAME_STATE_ARBITRATE) && !gpio_get(CEC_PIN)) {
+        // another initiator is sending a 0
+        hdmi_tx_arbitration_lost(frame, HDMI_FRAME_ABORT_ARBITRATION);
+        return 0;
+      }
       if (frame->bit--) {
         frame->state = HDMI_FRAME_STATE_DATA_LOW;
       } else {
@@ -496,54 +1651,461 @@ static int64_t hdmi_tx_callback(alarm_id_t alarm, void *user_data) {
       if (gpio_get(CEC_PIN) == false) {
         frame->ack = true;
       }
+      frame->end = time_us_64();
       frame->state = HDMI_FRAME_STATE_END;
       return time_next(frame->start, 2400);
     case HDMI_FRAME_STATE_END:
     default:
-      xTaskNotifyIndexedFromISR(xCECTask, NOTIFY_TX, 0, eNoAction, NULL);
+      vTaskNotifyGiveIndexedFromISR(xCECTxTask, NOTIFY_TX, NULL);
       return 0;
   }
 }
 
-static bool hdmi_tx_frame(uint8_t *data, uint8_t len) {
-  unsigned char i = 0;
+static int64_t hdmi_tx_callback(alarm_id_t alarm, void *user_data) {
+  uint32_t begin = cec_profile_begin();
+  int64_t next = hdmi_tx_frame_step((hdmi_frame_t *)user_data);
+
+  cec_profile_end(CEC_PROFILE_TX, begin);
+  return next;
+}
+#endif
+
+/**
+ * Check the bus is idle, the line is released and no frame is in progress.
+ */
+static bool hdmi_bus_idle(void) {
+  if (!gpio_get(CEC_PIN)) {
+    return false;
+  }
+#if CEC_PHY_PIO
+  // receiver waiting for a start bit
+  uint pc = pio_sm_get_pc(CEC_RX_PIO, cec_rx_sm) - cec_rx_offset;
+  return (pc == cec_rx_offset_start) || (pc == (cec_rx_offset_start + 1));
+#else
+  return rx_frame->state == HDMI_FRAME_STATE_START_LOW;
+#endif
+}
+
+/**
+ * The bus has been idle for idle_us and we are not transmitting, called by
+ * the NVS task before it stalls the interrupts to write flash.
+ */
+static bool cec_bus_quiet(uint32_t idle_us) {
+  return !tx_active && ((time_us_32() - bus_last_activity) >= idle_us) && hdmi_bus_idle();
+}
 
-  // wait 7 bit times of idle before sending
-  while (i < 7) {
-    vTaskDelay(pdMS_TO_TICKS(2.4));
-    if (gpio_get(CEC_PIN)) {
-      i++;
-    } else {
-      // reset
-      i = 0;
+static int64_t hdmi_tx_idle_alarm(alarm_id_t alarm, void *user_data) {
+  vTaskNotifyGiveIndexedFromISR(xCECTxTask, NOTIFY_TX, NULL);
+  return 0;
+}
+
+/**
+ * Wait for the signal free time, in bit periods.
+ *
+ * Sleeps until the signal free time has elapsed since the last bus activity,
+ * then sleeps again if there was activity in the meantime.
+ */
+static void hdmi_tx_wait_idle(unsigned int periods) {
+  uint32_t sft = periods * CEC_BIT_PERIOD_US;
+  uint32_t since = bus_last_activity;
+
+  while (true) {
+    uint32_t last = bus_last_activity;
+    if ((int32_t)(last - since) > 0) {
+      since = last;
+    }
+
+    uint32_t elapsed = time_us_32() - since;
+    if (elapsed < sft) {
+      if (add_alarm_in_us(sft - elapsed, hdmi_tx_idle_alarm, NULL, false) > 0) {
+        ulTaskNotifyTakeIndexed(NOTIFY_TX, pdTRUE, portMAX_DELAY);
+      }
+      continue;
+    }
+
+    if (hdmi_bus_idle()) {
+      return;
     }
+
+    // a frame is in progress without a recent edge (e.g. start bit)
+    since = time_us_32();
   }
+}
 
+static cec_tx_result_t hdmi_tx_frame(uint8_t *data, uint8_t len) {
   hdmi_message_t message = {data, len};
-  hdmi_frame_t frame = {.message = &message,
-                        .bit = 7,
-                        .byte = 0,
-                        .start = 0,
-                        .ack = false,
-                        .state = HDMI_FRAME_STATE_START_LOW};
-  add_alarm_at(from_us_since_boot(time_us_64()), hdmi_tx_callback, &frame, true);
-  ulTaskNotifyTakeIndexed(NOTIFY_TX, pdTRUE, portMAX_DELAY);
+  hdmi_frame_t frame;
+  unsigned int arb_attempts = 0;
+  unsigned int retransmits = 0;
+  unsigned int sft = bus_last_tx ? SFT_NEXT_FRAME : SFT_NEW_INITIATOR;
+
+  while (true) {
+    hdmi_tx_wait_idle(sft);
+
+    frame = (hdmi_frame_t){.message = &message,
+                           .bit = 7,
+                           .byte = 0,
+                           .start = 0,
+                           .ack = false,
+                           .state = HDMI_FRAME_STATE_START_LOW};
+    // drop a wakeup left over from an earlier frame, the next one ends this frame
+    ulTaskNotifyValueClearIndexed(NULL, NOTIFY_TX, UINT32_MAX);
+    tx_active = true;
+#if CEC_PHY_PIO
+    hdmi_tx_pio(&frame);
+#else
+    add_alarm_at(from_us_since_boot(time_us_64()), hdmi_tx_callback, &frame, true);
+    ulTaskNotifyTakeIndexed(NOTIFY_TX, pdTRUE, portMAX_DELAY);
+#endif
+    tx_active = false;
+
+    if (frame.state == HDMI_FRAME_STATE_ABORT) {
+      // lost arbitration, retry once the winning frame has finished
+      if (frame.abort == HDMI_FRAME_ABORT_BUSY) {
+        cec_stats.tx_arb_busy_frames++;
+      } else {
+        cec_stats.tx_arb_lost_frames++;
+      }
+      CEC_LOG_DEBUG(CEC_LOG_PHY, "Arbitration lost, reason %u"_CDC_BR, frame.abort);
+      if (++arb_attempts >= TX_ARB_ATTEMPTS) {
+        break;
+      }
+      sft = SFT_NEW_INITIATOR;
+      continue;
+    }
+
+    bus_last_activity = time_us_32();
+    bus_last_tx = true;
+
+    // retransmit directed frames that were not acknowledged, polls are
+    // answered by the ACK itself
+    uint8_t destination = data[0] & 0x0f;
+    if (frame.ack || (destination == 0x0f) || (len < 2) || (retransmits >= TX_RETRANSMITS)) {
+      break;
+    }
+    retransmits++;
+    cec_stats.tx_retransmit_frames++;
+    log_cec_frame(&frame, false);
+    sft = SFT_RETRY;
+  }
   // printf("high water mark = %lu\n", uxTaskGetStackHighWaterMark(xCECTask));
   log_cec_frame(&frame, false);
 
-  if (frame.ack) {
-    cec_stats.tx_frames++;
-  } else {
+  tx_last_timestamp = frame.timestamp;
+  tx_last_end = frame.end;
+
+  if (frame.state == HDMI_FRAME_STATE_ABORT) {
+    return CEC_TX_NOT_SENT;
+  }
+  if (!frame.ack) {
     cec_stats.tx_noack_frames++;
+    return CEC_TX_NACKED;
+  }
+  cec_stats.tx_frames++;
+
+  return CEC_TX_ACKED;
+}
+
+static unsigned int cec_latency_bucket(uint64_t us) {
+  unsigned int i;
+
+  for (i = 0; i < (CEC_LATENCY_BUCKETS - 1); i++) {
+    if (us < (cec_latency_bucket_ms[i] * 1000ULL)) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+/**
+ * Record the latency of a reply, from the end of the request frame to the
+ * start bit and to the ACK of the reply.
+ */
+static void cec_latency_record(uint8_t opcode, uint64_t start_us, uint64_t ack_us, bool ack) {
+  cec_latency_hist_t *hist = NULL;
+
+  taskENTER_CRITICAL();
+  for (unsigned int i = 0; i < CEC_LATENCY_OPCODES; i++) {
+    cec_latency_hist_t *h = &latency_stats.opcode[i];
+    if ((h->count > 0) && (h->opcode == opcode)) {
+      hist = h;
+      break;
+    }
+    if ((hist == NULL) && (h->count == 0)) {
+      hist = h;
+    }
+  }
+
+  if (hist == NULL) {
+    latency_stats.dropped++;
+  } else {
+    hist->opcode = opcode;
+    hist->count++;
+    hist->start[cec_latency_bucket(start_us)]++;
+    hist->start_max_us = MAX(hist->start_max_us, start_us);
+    if (ack) {
+      hist->ack[cec_latency_bucket(ack_us)]++;
+      hist->ack_max_us = MAX(hist->ack_max_us, ack_us);
+    }
+  }
+  taskEXIT_CRITICAL();
+}
+
+void cec_get_latency_stats(cec_latency_stats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = latency_stats;
+  taskEXIT_CRITICAL();
+}
+
+void cec_get_opcode_stats(uint8_t opcode, cec_opcode_stats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = opcode_stats[opcode];
+  taskEXIT_CRITICAL();
+}
+
+const char *cec_get_opcode_name(uint8_t opcode) {
+  return cec_opcode[opcode].name;
+}
+
+void cec_get_rx_timing_stats(cec_rx_timing_stats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = rx_timing_stats;
+  taskEXIT_CRITICAL();
+}
+
+void cec_reset_rx_timing_stats(void) {
+  taskENTER_CRITICAL();
+  memset(&rx_timing_stats, 0, sizeof(rx_timing_stats));
+  taskEXIT_CRITICAL();
+}
+
+void cec_reset_latency_stats(void) {
+  taskENTER_CRITICAL();
+  memset(&latency_stats, 0, sizeof(latency_stats));
+  taskEXIT_CRITICAL();
+}
+
+/**
+ * Copy a cached reply's body after its header, straight into the frame to be
+ * sent, and release the cache copy it came from.
+ */
+static void cec_tx_request_take(cec_tx_request_t *req) {
+  if (req->reply == NULL) {
+    return;
+  }
+
+  memcpy(&req->data[1], req->reply->data, req->reply->len);
+  taskENTER_CRITICAL();
+  reply_cache_queued[req->reply_copy]--;
+  taskEXIT_CRITICAL();
+  req->reply = NULL;
+}
+
+static void cec_tx_task(void *data) {
+  while (true) {
+    cec_tx_request_t req;
+    unsigned int i;
+
+    for (i = 0; i < CEC_TX_PRIORITY_COUNT; i++) {
+      if (xQueueReceive(tx_queue[i], &req, 0) == pdTRUE) {
+        break;
+      }
+    }
+
+    if (i == CEC_TX_PRIORITY_COUNT) {
+      ulTaskNotifyTakeIndexed(NOTIFY_TX_QUEUE, pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    cec_tx_request_take(&req);
+
+    cec_tx_result_t result = hdmi_tx_frame(req.data, req.len);
+    bool ack = (result == CEC_TX_ACKED);
+    if (req.len > 1) {
+      opcode_stats[req.data[1]].tx++;
+    }
+    if (req.timed && (tx_last_timestamp > req.request_end)) {
+      cec_latency_record(req.request_opcode, tx_last_timestamp - req.request_end,
+                         ack ? (tx_last_end - req.request_end) : 0, ack);
+    }
+    if (req.done != NULL) {
+      req.done(result, req.ctx);
+    }
+  }
+}
+
+/**
+ * Create the transmit queues and task.
+ */
+static void cec_tx_init(void) {
+  static const UBaseType_t length[CEC_TX_PRIORITY_COUNT] = {
+      [CEC_TX_PRIORITY_REPLY] = CEC_TX_REPLY_QUEUE_LENGTH,
+      [CEC_TX_PRIORITY_BROADCAST] = CEC_TX_BROADCAST_QUEUE_LENGTH,
+      [CEC_TX_PRIORITY_POLL] = CEC_TX_POLL_QUEUE_LENGTH,
+  };
+  static StaticQueue_t queue_static[CEC_TX_PRIORITY_COUNT];
+  static uint8_t reply_storage[CEC_TX_REPLY_QUEUE_LENGTH * sizeof(cec_tx_request_t)];
+  static uint8_t broadcast_storage[CEC_TX_BROADCAST_QUEUE_LENGTH * sizeof(cec_tx_request_t)];
+  static uint8_t poll_storage[CEC_TX_POLL_QUEUE_LENGTH * sizeof(cec_tx_request_t)];
+  static uint8_t *storage[CEC_TX_PRIORITY_COUNT] = {
+      [CEC_TX_PRIORITY_REPLY] = reply_storage,
+      [CEC_TX_PRIORITY_BROADCAST] = broadcast_storage,
+      [CEC_TX_PRIORITY_POLL] = poll_storage,
+  };
+  static StaticTask_t tx_task_static;
+  static StackType_t tx_stack[CEC_TX_STACK_SIZE];
+
+  for (unsigned int i = 0; i < CEC_TX_PRIORITY_COUNT; i++) {
+    tx_queue[i] =
+        xQueueCreateStatic(length[i], sizeof(cec_tx_request_t), storage[i], &queue_static[i]);
+  }
+
+  xCECTxTask = xTaskCreateStatic(cec_tx_task, CEC_TX_TASK_NAME, CEC_TX_STACK_SIZE, NULL,
+                                 configMAX_PRIORITIES - 1, &tx_stack[0], &tx_task_static);
+}
+
+static bool cec_tx_submit(const cec_tx_request_t *req, cec_tx_priority_t priority) {
+  if ((xCECTxTask == NULL) || (req->len < 1) || (req->len > 16) ||
+      (priority >= CEC_TX_PRIORITY_COUNT)) {
+    return false;
+  }
+
+  if (xQueueSend(tx_queue[priority], req, 0) != pdTRUE) {
+    cec_stats.tx_queue_full++;
+    return false;
+  }
+  xTaskNotifyGiveIndexed(xCECTxTask, NOTIFY_TX_QUEUE);
+
+  return true;
+}
+
+bool cec_send_async(const uint8_t *data,
+                    uint8_t len,
+                    cec_tx_priority_t priority,
+                    cec_tx_done_t done,
+                    void *ctx) {
+  cec_tx_request_t req = {.len = len, .done = done, .ctx = ctx};
+
+  if ((len < 1) || (len > 16)) {
+    return false;
+  }
+  memcpy(req.data, data, len);
+
+  return cec_tx_submit(&req, priority);
+}
+
+typedef struct {
+  TaskHandle_t task;
+  cec_tx_result_t result;
+} send_frame_wait_t;
+
+static void send_frame_done(cec_tx_result_t result, void *ctx) {
+  send_frame_wait_t *wait = (send_frame_wait_t *)ctx;
+
+  wait->result = result;
+  xTaskNotifyGiveIndexed(wait->task, NOTIFY_TX);
+}
+
+/**
+ * Send a frame and wait for the result, polls are sent last.
+ */
+static cec_tx_result_t send_frame(uint8_t pldcnt, uint8_t *pld) {
+  send_frame_wait_t wait = {.task = xTaskGetCurrentTaskHandle(), .result = CEC_TX_NOT_SENT};
+  cec_tx_priority_t priority = (pldcnt == 1) ? CEC_TX_PRIORITY_POLL
+                               : ((pld[0] & 0x0f) == 0x0f) ? CEC_TX_PRIORITY_BROADCAST
+                                                           : CEC_TX_PRIORITY_REPLY;
+
+  if (!cec_send_async(pld, pldcnt, priority, send_frame_done, &wait)) {
+    return CEC_TX_NOT_SENT;
+  }
+  ulTaskNotifyTakeIndexed(NOTIFY_TX, pdTRUE, portMAX_DELAY);
+
+  return wait.result;
+}
+
+/**
+ * Queue a reply without waiting, directed replies go ahead of broadcasts.
+ */
+static void send_reply(uint8_t pldcnt, uint8_t *pld) {
+  cec_tx_priority_t priority =
+      ((pld[0] & 0x0f) == 0x0f) ? CEC_TX_PRIORITY_BROADCAST : CEC_TX_PRIORITY_REPLY;
+  cec_tx_request_t req = {.len = pldcnt,
+                          .timed = reply_to.valid,
+                          .request_opcode = reply_to.opcode,
+                          .request_end = reply_to.end};
+
+  memcpy(req.data, pld, pldcnt);
+  cec_tx_submit(&req, priority);
+}
+
+/**
+ * Queue a reply from the cache without waiting. Only the header block is
+ * written, the request points at the cached body and cec_tx copies it into
+ * the frame when it is sent.
+ */
+static void send_cached_reply(uint8_t initiator, uint8_t destination, const cec_reply_t *reply) {
+  cec_tx_priority_t priority =
+      (destination == 0x0f) ? CEC_TX_PRIORITY_BROADCAST : CEC_TX_PRIORITY_REPLY;
+  cec_tx_request_t req = {.len = reply->len + 1,
+                          .reply = reply,
+                          .reply_copy = reply_cache - reply_caches,
+                          .timed = reply_to.valid,
+                          .request_opcode = reply_to.opcode,
+                          .request_end = reply_to.end};
+
+  req.data[0] = HEADER0(initiator, destination);
+  taskENTER_CRITICAL();
+  reply_cache_queued[req.reply_copy]++;
+  taskEXIT_CRITICAL();
+  if (!cec_tx_submit(&req, priority)) {
+    taskENTER_CRITICAL();
+    reply_cache_queued[req.reply_copy]--;
+    taskEXIT_CRITICAL();
   }
+}
 
-  return frame.ack;
+static void reply_set(cec_reply_t *reply, const uint8_t *data, uint8_t len) {
+  memcpy(reply->data, data, len);
+  reply->len = len;
 }
 
-static bool send_frame(uint8_t pldcnt, uint8_t *pld) {
-  // disable GPIO ISR for sending
-  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
-  return hdmi_tx_frame(pld, pldcnt);
+/**
+ * Rebuild the cached replies, after the configuration or the physical address
+ * changed. Only called by cec_task, which also queues the replies.
+ */
+static void reply_cache_update(void) {
+  reply_cache_t *next = (reply_cache == &reply_caches[0]) ? &reply_caches[1] : &reply_caches[0];
+
+  // replies from the copy before last may still be queued, they go out first
+  while (reply_cache_queued[next - reply_caches] != 0) {
+    vTaskDelay(pdMS_TO_TICKS(REPLY_CACHE_POLL_MS));
+  }
+
+  uint8_t osd_name[1 + CEC_CONFIG_OSD_NAME_LEN] = {CEC_ID_SET_OSD_NAME};
+  uint8_t n = strnlen(config.osd_name, CEC_CONFIG_OSD_NAME_LEN);
+  memcpy(&osd_name[1], config.osd_name, n);
+  reply_set(&next->osd_name, osd_name, 1 + n);
+
+  uint8_t vendor_id[4] = {CEC_ID_DEVICE_VENDOR_ID, (config.vendor_id >> 16) & 0x0ff,
+                          (config.vendor_id >> 8) & 0x0ff, (config.vendor_id >> 0) & 0x0ff};
+  reply_set(&next->vendor_id, vendor_id, sizeof(vendor_id));
+
+  // 0x06 = 2.0
+  uint8_t cec_version[2] = {CEC_ID_CEC_VERSION, 0x06};
+  reply_set(&next->cec_version, cec_version, sizeof(cec_version));
+
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t power_status[2] = {CEC_ID_REPORT_POWER_STATUS, i};
+    reply_set(&next->power_status[i], power_status, sizeof(power_status));
+  }
+
+  for (uint8_t type = 0; type < NUM_TYPES; type++) {
+    uint8_t physical_address[4] = {CEC_ID_REPORT_PHYSICAL_ADDRESS, (paddr >> 8) & 0x0ff,
+                                   (paddr >> 0) & 0x0ff, type};
+    reply_set(&next->physical_address[type], physical_address, sizeof(physical_address));
+  }
+
+  reply_cache = next;
 }
 
 static void cec_feature_abort(uint8_t initiator,
@@ -552,20 +2114,15 @@ static void cec_feature_abort(uint8_t initiator,
                               cec_abort_t reason) {
   uint8_t pld[4] = {HEADER0(initiator, destination), CEC_ID_FEATURE_ABORT, msg, reason};
 
-  send_frame(4, pld);
+  send_reply(4, pld);
 }
 
-static void device_vendor_id(uint8_t initiator, uint8_t destination, uint32_t vendor_id) {
-  uint8_t pld[5] = {HEADER0(initiator, destination), CEC_ID_DEVICE_VENDOR_ID,
-                    (vendor_id >> 16) & 0x0ff, (vendor_id >> 8) & 0x0ff, (vendor_id >> 0) & 0x0ff};
-
-  send_frame(5, pld);
+static void device_vendor_id(uint8_t initiator, uint8_t destination) {
+  send_cached_reply(initiator, destination, &reply_cache->vendor_id);
 }
 
-static void report_power_status(uint8_t initiator, uint8_t destination, uint8_t power_status) {
-  uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_REPORT_POWER_STATUS, power_status};
-
-  send_frame(3, pld);
+static void report_power_status(uint8_t initiator, uint8_t destination, bool standby) {
+  send_cached_reply(initiator, destination, &reply_cache->power_status[standby]);
 }
 
 static void set_system_audio_mode(uint8_t initiator,
@@ -574,13 +2131,13 @@ static void set_system_audio_mode(uint8_t initiator,
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_SET_SYSTEM_AUDIO_MODE,
                     system_audio_mode};
 
-  send_frame(3, pld);
+  send_reply(3, pld);
 }
 
 static void report_audio_status(uint8_t initiator, uint8_t destination, uint8_t audio_status) {
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_REPORT_AUDIO_STATUS, audio_status};
 
-  send_frame(3, pld);
+  send_reply(3, pld);
 }
 
 static void system_audio_mode_status(uint8_t initiator,
@@ -589,33 +2146,48 @@ static void system_audio_mode_status(uint8_t initiator,
   uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_SYSTEM_AUDIO_MODE_STATUS,
                     system_audio_mode_status};
 
-  send_frame(3, pld);
+  send_reply(3, pld);
 }
 
 static void set_osd_name(uint8_t initiator, uint8_t destination) {
-  uint8_t pld[13] = {
-      HEADER0(initiator, destination), CEC_ID_SET_OSD_NAME, 'R', 'e', 't', 'r', 'o', 'T', 'i', 'n', 'k', '4', 'K'};
+  send_cached_reply(initiator, destination, &reply_cache->osd_name);
+}
 
-  send_frame(13, pld);
+static void report_physical_address(uint8_t initiator, uint8_t destination, uint8_t device_type) {
+  send_cached_reply(initiator, destination, &reply_cache->physical_address[device_type]);
 }
 
-static void report_physical_address(uint8_t initiator,
-                                    uint8_t destination,
-                                    uint16_t physical_address,
-                                    uint8_t device_type) {
-  uint8_t pld[5] = {HEADER0(initiator, destination), CEC_ID_REPORT_PHYSICAL_ADDRESS,
-                    (physical_address >> 8) & 0x0ff, (physical_address >> 0) & 0x0ff, device_type};
+static void report_cec_version(uint8_t initiator, uint8_t destination) {
+  send_cached_reply(initiator, destination, &reply_cache->cec_version);
+}
+
+static void deck_status(uint8_t initiator, uint8_t destination, uint8_t deck_info) {
+  uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_DECK_STATUS, deck_info};
 
-  send_frame(5, pld);
+  send_reply(3, pld);
 }
 
-static void report_cec_version(uint8_t initiator, uint8_t destination) {
-  // 0x04 = 1.3a
-  uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_CEC_VERSION, 0x04};
-  send_frame(3, pld);
+static void menu_status(uint8_t initiator, uint8_t destination, uint8_t menu_state) {
+  uint8_t pld[3] = {HEADER0(initiator, destination), CEC_ID_MENU_STATUS, menu_state};
+
+  send_reply(3, pld);
+}
+
+static void report_features(uint8_t initiator,
+                            uint8_t all_device_types,
+                            uint8_t rc_profile,
+                            uint8_t device_features) {
+  // 0x06 = 2.0
+  uint8_t pld[6] = {HEADER0(initiator, 0x0f), CEC_ID_REPORT_FEATURES, 0x06, all_device_types,
+                    rc_profile, device_features};
+
+  send_reply(6, pld);
 }
 
-bool cec_ping(uint8_t destination) {
+/**
+ * Poll a logical address, a NACK is the only proof that it is free.
+ */
+static cec_tx_result_t cec_ping(uint8_t destination) {
   uint8_t pld[1] = {HEADER0(destination, destination)};
 
   return send_frame(1, pld);
@@ -624,42 +2196,142 @@ bool cec_ping(uint8_t destination) {
 static void image_view_on(uint8_t initiator, uint8_t destination) {
   uint8_t pld[2] = {HEADER0(initiator, destination), CEC_ID_IMAGE_VIEW_ON};
 
-  send_frame(2, pld);
+  send_reply(2, pld);
 }
 
 static void active_source(uint8_t initiator, uint16_t physical_address) {
   uint8_t pld[4] = {HEADER0(initiator, 0x0f), CEC_ID_ACTIVE_SOURCE, (physical_address >> 8) & 0x0ff,
                     (physical_address >> 0) & 0x0ff};
 
-  send_frame(4, pld);
+  send_reply(4, pld);
 }
 
 void cec_get_stats(hdmi_cec_stats_t *stats) {
   *stats = cec_stats;
 }
 
-static uint8_t allocate_logical_address(cec_config_t *config) {
-  if (config->logical_address != 0x00 && config->logical_address != 0x0f) {
+/**
+ * Allocate a logical address of the device type for the physical address.
+ *
+ * The previous allocation is kept unless the physical address changed or
+ * another device was seen using our address. The last allocated addresses are
+ * persisted and polled first, so an unchanged bus is claimed with one poll
+ * per device type. A last address found taken is not polled again with the
+ * other candidates. Only an address whose poll went unacknowledged is claimed.
+ * Returns 0x0f if every candidate is taken, or if a poll could not be sent,
+ * in which case nothing is cached and the caller tries again later.
+ */
+static uint8_t allocate_logical_address(cec_config_t *config,
+                                        uint8_t device_type,
+                                        uint16_t physical_address) {
+  if ((device_type == config->device_type) && (config->logical_address != 0x00)
+      && (config->logical_address != 0x0f)) {
     return config->logical_address;
   }
 
+  if (laddr_cache[device_type].valid && !laddr_cache[device_type].conflict
+      && (laddr_cache[device_type].paddr == physical_address)) {
+    return laddr_cache[device_type].laddr;
+  }
+
   // Treat 0x00 or 0x0f as auto-allocate
-  uint8_t a;
-  for (unsigned int i = 0; i < NUM_LADDRESS; i++) {
-    a = laddress[config->device_type][i];
-    cec_log_submitf("Attempting to allocate logical address 0x%01hhx"_CDC_BR, a);
-    if (!cec_ping(a)) {
+  uint8_t a = 0x0f;
+  for (unsigned int i = 0; (i < NUM_LADDRESS) && (laddress[device_type][i] != 0x0f); i++) {
+    if (config->last_logical_addresses & (1u << laddress[device_type][i])) {
+      a = laddress[device_type][i];
       break;
     }
   }
+  cec_tx_result_t result = CEC_TX_ACKED;
+  uint8_t taken = 0x0f;
+  if (!laddr_cache[device_type].conflict && (a != 0x0f)) {
+    result = cec_ping(a);
+    taken = a;
+  }
+  if (result == CEC_TX_ACKED) {
+    a = 0x0f;
+    for (unsigned int i = 0; (i < NUM_LADDRESS) && (laddress[device_type][i] != 0x0f); i++) {
+      if (laddress[device_type][i] == taken) {
+        // just acknowledged, no need to poll it again
+        continue;
+      }
+      CEC_LOG_DEBUG(CEC_LOG_PROTO, "Attempting to allocate logical address 0x%01hhx"_CDC_BR,
+                    laddress[device_type][i]);
+      result = cec_ping(laddress[device_type][i]);
+      if (result != CEC_TX_ACKED) {
+        a = laddress[device_type][i];
+        break;
+      }
+    }
+  }
+
+  if (result == CEC_TX_NOT_SENT) {
+    CEC_LOG_WARN(CEC_LOG_PROTO, "Could not poll 0x%02x for device type %u, retrying"_CDC_BR, a,
+                 device_type);
+    laddr_cache[device_type].valid = false;
+    return 0x0f;
+  }
+
+  CEC_LOG_INFO(CEC_LOG_PROTO, "Allocated logical address 0x%02x for device type %u"_CDC_BR, a,
+               device_type);
+  laddr_cache[device_type].valid = true;
+  laddr_cache[device_type].conflict = false;
+  laddr_cache[device_type].paddr = physical_address;
+  laddr_cache[device_type].laddr = a;
+
+  if (a != 0x0f) {
+    // saved by the caller through the NVS task
+    for (unsigned int i = 0; i < NUM_LADDRESS; i++) {
+      config->last_logical_addresses &= ~(1u << laddress[device_type][i]);
+    }
+    config->last_logical_addresses |= (1u << a);
+  }
 
-  cec_log_submitf("Allocated logical address 0x%02x"_CDC_BR, a);
   return a;
 }
 
-uint16_t get_physical_address(const cec_config_t *config) {
-  return (config->physical_address == 0x0000) ? ddc_get_physical_address()
-                                              : config->physical_address;
+/**
+ * Device types claimed, a bit per type.
+ */
+static uint8_t claimed_types(void) {
+  uint8_t types = (1u << config.device_type) | config.extra_device_types;
+
+  return types & ((1u << NUM_TYPES) - 1) & ~LADDRESS_UNCLAIMABLE;
+}
+
+/**
+ * Device type one of our logical addresses was claimed for.
+ */
+static uint8_t laddress_type(uint8_t address) {
+  for (uint8_t type = 0; type < NUM_TYPES; type++) {
+    if ((type_laddr[type] == address) && (claimed_types() & (1u << type))) {
+      return type;
+    }
+  }
+
+  return config.device_type;
+}
+
+/* All Device Types operand bit per device type. */
+static const uint8_t all_device_types[NUM_TYPES] = {0x80, 0x40, 0x00, 0x20, 0x10, 0x08};
+
+/**
+ * Broadcast the CEC 2.0 features from one of our logical addresses.
+ *
+ * All Device Types lists every claimed device type. The RC profile only
+ * marks a source device, no menus are reported and there are no device
+ * features.
+ */
+static void report_our_features(uint8_t address) {
+  uint8_t types = claimed_types();
+  uint8_t all = 0x00;
+
+  for (uint8_t type = 0; type < NUM_TYPES; type++) {
+    if (types & (1u << type)) {
+      all |= all_device_types[type];
+    }
+  }
+  report_features(address, all, 0x40, 0x00);
 }
 
 uint16_t cec_get_physical_address(void) {
@@ -670,196 +2342,537 @@ uint8_t cec_get_logical_address(void) {
   return laddr;
 }
 
+uint16_t cec_get_logical_addresses(void) {
+  return laddr_mask;
+}
+
+/**
+ * Note a topology change, handled once TOPOLOGY_SETTLE_MS has passed.
+ */
+static void topology_changed(bool routing, bool report) {
+  if (!topology.pending) {
+    topology.pending = true;
+    topology.due = xTaskGetTickCount() + pdMS_TO_TICKS(TOPOLOGY_SETTLE_MS);
+  }
+  topology.routing |= routing;
+  topology.report |= report;
+}
+
+/**
+ * Ticks until the pending topology change is due, 0 if it is due now.
+ */
+static TickType_t topology_timeout(void) {
+  if (!topology.pending || topology.waiting) {
+    return portMAX_DELAY;
+  }
+
+  TickType_t remaining = topology.due - xTaskGetTickCount();
+
+  return ((int32_t)remaining > 0) ? remaining : 0;
+}
+
+/**
+ * Re-evaluate the addresses once for a burst of topology changes.
+ */
+static void topology_update(uint16_t physical_address) {
+  uint16_t old_mask = laddr_mask;
+  uint16_t old_paddr = paddr;
+  uint16_t last = config.last_logical_addresses;
+  uint8_t types = claimed_types();
+  uint16_t mask = 0x0000;
+  bool retry = false;
+
+  paddr = physical_address;
+  if (paddr != old_paddr) {
+    reply_cache_update();
+  }
+  for (uint8_t type = 0; type < NUM_TYPES; type++) {
+    type_laddr[type] = 0x0f;
+    if (types & (1u << type)) {
+      type_laddr[type] = allocate_logical_address(&config, type, paddr);
+      retry |= (type_laddr[type] == 0x0f) && !laddr_cache[type].valid;
+    }
+    if (type_laddr[type] != 0x0f) {
+      mask |= (1u << type_laddr[type]);
+    }
+  }
+  laddr = type_laddr[config.device_type];
+  laddr_mask = mask;
+  if (config.last_logical_addresses != last) {
+    // flash writes stall the bus, left to the NVS task once it is quiet
+    nvs_request_save();
+  }
+
+  if (topology.routing && (paddr == active_addr)) {
+    image_view_on(laddr, 0x00);
+    active_source(laddr, paddr);
+  }
+
+  if ((topology.report || (laddr_mask != old_mask) || (paddr != old_paddr)) && (paddr != 0x0000)) {
+    // the configured device type reports even when unregistered
+    for (uint8_t type = 0; type < NUM_TYPES; type++) {
+      if ((type_laddr[type] != 0x0f) || (type == config.device_type)) {
+        report_physical_address(type_laddr[type], 0x0f, type);
+      }
+      if (type_laddr[type] != 0x0f) {
+        report_our_features(type_laddr[type]);
+      }
+    }
+  }
+
+  // plugged again while the EDID was being read, or a poll never made it
+  // onto the bus, go again
+  topology.pending = topology.hotplug || retry;
+  topology.due = xTaskGetTickCount() + (topology.hotplug ? 0 : pdMS_TO_TICKS(TOPOLOGY_SETTLE_MS));
+  topology.waiting = false;
+  topology.routing = false;
+  topology.report = topology.hotplug;
+}
+
+/**
+ * Re-enumerate after a plug event, the HPD debounce already settled it.
+ */
+static void topology_hotplug(void) {
+  topology_changed(false, true);
+  topology.hotplug = true;
+  if (!topology.waiting) {
+    topology.due = xTaskGetTickCount();
+  }
+}
+
+/**
+ * Start the re-evaluation, the EDID is read by the DDC task meanwhile.
+ */
+static void topology_resolve(void) {
+  if (topology.hotplug) {
+    for (uint8_t type = 0; type < NUM_TYPES; type++) {
+      laddr_cache[type].valid = false;
+    }
+  }
+
+  if (config.physical_address != 0x0000) {
+    topology.hotplug = false;
+    topology_update(config.physical_address);
+    return;
+  }
+
+  // the sink may have changed, check the cached EDID
+  ddc_refresh(topology.hotplug);
+  topology.hotplug = false;
+  ddc_request_physical_address(xCECTask, NOTIFY_DDC);
+  topology.waiting = true;
+}
+
+/* Queue of user control keys for the HID task. */
+static QueueHandle_t *hid_queue;
+
+/* Requests for the active source that went unanswered. */
+static uint8_t no_active = 0;
+
+static void handle_standby(uint8_t initiator,
+                           uint8_t destination,
+                           const uint8_t *pld,
+                           uint8_t pldcnt) {
+  active_addr = 0x0000;
+  blink_set_blink(BLINK_STATE_BLUE_2HZ);
+}
+
+static void handle_system_audio_mode_request(uint8_t initiator,
+                                             uint8_t destination,
+                                             const uint8_t *pld,
+                                             uint8_t pldcnt) {
+  set_system_audio_mode(destination, initiator, audio_status);
+}
+
+static void handle_give_audio_status(uint8_t initiator,
+                                     uint8_t destination,
+                                     const uint8_t *pld,
+                                     uint8_t pldcnt) {
+  report_audio_status(destination, initiator, 0x32);  // volume 50%, mute off
+}
+
+static void handle_set_system_audio_mode(uint8_t initiator,
+                                         uint8_t destination,
+                                         const uint8_t *pld,
+                                         uint8_t pldcnt) {
+  audio_status = (pld[2] == 1);
+}
+
+static void handle_give_system_audio_mode_status(uint8_t initiator,
+                                                 uint8_t destination,
+                                                 const uint8_t *pld,
+                                                 uint8_t pldcnt) {
+  system_audio_mode_status(destination, initiator, audio_status);
+}
+
+static void handle_routing_change(uint8_t initiator,
+                                  uint8_t destination,
+                                  const uint8_t *pld,
+                                  uint8_t pldcnt) {
+  // uint16_t old_addr = (pld[2] << 8) | pld[3];
+  active_addr = (pld[4] << 8) | pld[5];
+  topology_changed(true, false);
+}
+
+static void handle_active_source(uint8_t initiator,
+                                 uint8_t destination,
+                                 const uint8_t *pld,
+                                 uint8_t pldcnt) {
+  active_addr = (pld[2] << 8) | pld[3];
+  no_active = 0;
+}
+
+static void handle_report_physical_address(uint8_t initiator,
+                                           uint8_t destination,
+                                           const uint8_t *pld,
+                                           uint8_t pldcnt) {
+  // On broadcast receive from the TV, do the same
+  if (initiator == 0x00) {
+    topology_changed(false, true);
+  }
+}
+
+static void handle_request_active_source(uint8_t initiator,
+                                         uint8_t destination,
+                                         const uint8_t *pld,
+                                         uint8_t pldcnt) {
+  no_active++;
+  if (paddr == active_addr || no_active > 2) {
+    image_view_on(laddr, 0x00);
+    active_source(laddr, paddr);
+    no_active = 0;
+  }
+}
+
+static void handle_set_stream_path(uint8_t initiator,
+                                   uint8_t destination,
+                                   const uint8_t *pld,
+                                   uint8_t pldcnt) {
+  if (paddr == ((pld[2] << 8) | pld[3])) {
+    active_addr = paddr;
+    image_view_on(laddr, 0x00);
+    active_source(laddr, paddr);
+    no_active = 0;
+    blink_set_blink(BLINK_STATE_GREEN_2HZ);
+  }
+}
+
+static void handle_device_vendor_id(uint8_t initiator,
+                                    uint8_t destination,
+                                    const uint8_t *pld,
+                                    uint8_t pldcnt) {
+  // On broadcast receive from the TV, do the same
+  if (initiator == 0x00) {
+    device_vendor_id(laddr, 0x0f);
+  }
+}
+
+static void handle_give_device_vendor_id(uint8_t initiator,
+                                         uint8_t destination,
+                                         const uint8_t *pld,
+                                         uint8_t pldcnt) {
+  device_vendor_id(destination, 0x0f);
+}
+
+static void handle_give_device_power_status(uint8_t initiator,
+                                            uint8_t destination,
+                                            const uint8_t *pld,
+                                            uint8_t pldcnt) {
+  report_power_status(destination, initiator, active_addr != paddr);
+#if 0
+  /* Hack for Google Chromecast to force it sending V+/V- if no CEC TV is present */
+  if (destination == 0)
+    report_power_status(0, initiator, 0x00);
+#endif
+}
+
+static void handle_get_cec_version(uint8_t initiator,
+                                   uint8_t destination,
+                                   const uint8_t *pld,
+                                   uint8_t pldcnt) {
+  report_cec_version(destination, initiator);
+}
+
+static void handle_give_osd_name(uint8_t initiator,
+                                 uint8_t destination,
+                                 const uint8_t *pld,
+                                 uint8_t pldcnt) {
+  set_osd_name(destination, initiator);
+}
+
+static void handle_give_physical_address(uint8_t initiator,
+                                         uint8_t destination,
+                                         const uint8_t *pld,
+                                         uint8_t pldcnt) {
+  if (paddr != 0x0000) {
+    report_physical_address(destination, 0x0f, laddress_type(destination));
+  }
+}
+
+static void handle_user_control_pressed(uint8_t initiator,
+                                        uint8_t destination,
+                                        const uint8_t *pld,
+                                        uint8_t pldcnt) {
+  // the keymap stops short of 0xff, which is not a UI command
+  if (pld[2] >= (sizeof(config.keymap) / sizeof(config.keymap[0]))) {
+    return;
+  }
+  blink_set(BLINK_STATE_GREEN_ON);
+  command_t command = config.keymap[pld[2]];
+#ifdef DEBUG
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "remote cec_key: 0x%02X\n", command.key);
+  tuh_cdc_write(0, buffer, strlen(buffer));
+  tuh_cdc_write_flush(0);
+#else
+  if (command.name != NULL) {
+    xQueueSend(*hid_queue, &command.key, pdMS_TO_TICKS(10));
+  }
+#endif
+}
+
+static void handle_user_control_released(uint8_t initiator,
+                                         uint8_t destination,
+                                         const uint8_t *pld,
+                                         uint8_t pldcnt) {
+  blink_set(BLINK_STATE_OFF);
+  // uint8_t key = HID_KEY_NONE;
+  // xQueueSend(*hid_queue, &key, pdMS_TO_TICKS(10));
+}
+
+static void handle_give_deck_status(uint8_t initiator,
+                                    uint8_t destination,
+                                    const uint8_t *pld,
+                                    uint8_t pldcnt) {
+  uint8_t type = laddress_type(destination);
+
+  if ((type != CEC_CONFIG_DEVICE_TYPE_PLAYBACK) && (type != CEC_CONFIG_DEVICE_TYPE_RECORDING)) {
+    cec_feature_abort(destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+    return;
+  }
+
+  // status request 0x01 on, 0x02 off, 0x03 once, changes are not reported
+  if ((pld[2] == 0x01) || (pld[2] == 0x03)) {
+    // deck info 0x11 play, 0x1a stop
+    deck_status(destination, initiator, (active_addr == paddr) ? 0x11 : 0x1a);
+  }
+}
+
+static void handle_menu_request(uint8_t initiator,
+                                uint8_t destination,
+                                const uint8_t *pld,
+                                uint8_t pldcnt) {
+  // menu request type 0x00 activate, 0x01 deactivate, 0x02 query
+  if (pld[2] == 0x00) {
+    menu_active = true;
+  } else if (pld[2] == 0x01) {
+    menu_active = false;
+  }
+  // menu state 0x00 activated, 0x01 deactivated
+  menu_status(destination, initiator, menu_active ? 0x00 : 0x01);
+}
+
+static void handle_give_features(uint8_t initiator,
+                                 uint8_t destination,
+                                 const uint8_t *pld,
+                                 uint8_t pldcnt) {
+  report_our_features(destination);
+}
+
+/**
+ * Requests only a TV answers, aborted so the initiator does not retry.
+ */
+static void handle_tv_only(uint8_t initiator,
+                           uint8_t destination,
+                           const uint8_t *pld,
+                           uint8_t pldcnt) {
+  cec_feature_abort(destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+}
+
+static void handle_abort(uint8_t initiator,
+                         uint8_t destination,
+                         const uint8_t *pld,
+                         uint8_t pldcnt) {
+  cec_feature_abort(destination, initiator, pld[1], CEC_ABORT_REFUSED);
+}
+
+static const cec_opcode_t cec_opcode[UINT8_MAX + 1] = {
+    [CEC_ID_FEATURE_ABORT] = {"Feature Abort", 2, CEC_ADDR_DIRECTED, NULL, decode_feature_abort},
+    [CEC_ID_IMAGE_VIEW_ON] = {"Image View On", 0, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_TEXT_VIEW_ON] = {"Text View On", 0, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_GIVE_DECK_STATUS] = {"Give Deck Status", 1, CEC_ADDR_DIRECTED, handle_give_deck_status,
+                                 decode_operands},
+    [CEC_ID_DECK_STATUS] = {"Deck Status", 1, CEC_ADDR_DIRECTED, NULL, decode_operands},
+    [CEC_ID_SET_MENU_LANGUAGE] = {"Set Menu Language", 3, CEC_ADDR_BROADCAST, NULL, NULL},
+    [CEC_ID_STANDBY] = {"Standby", 0, CEC_ADDR_BOTH, handle_standby, decode_standby},
+    [CEC_ID_USER_CONTROL_PRESSED] = {"User Control Pressed", 1, CEC_ADDR_DIRECTED,
+                                     handle_user_control_pressed, decode_user_control},
+    [CEC_ID_USER_CONTROL_RELEASED] = {"User Control Released", 0, CEC_ADDR_DIRECTED,
+                                      handle_user_control_released, NULL},
+    [CEC_ID_GIVE_OSD_NAME] = {"Give OSD Name", 0, CEC_ADDR_DIRECTED, handle_give_osd_name, NULL},
+    [CEC_ID_SET_OSD_NAME] = {"Set OSD Name", 1, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_SYSTEM_AUDIO_MODE_REQUEST] = {"System Audio Mode Request", 0, CEC_ADDR_DIRECTED,
+                                          handle_system_audio_mode_request, NULL},
+    [CEC_ID_GIVE_AUDIO_STATUS] = {"Give Audio Status", 0, CEC_ADDR_DIRECTED,
+                                  handle_give_audio_status, NULL},
+    [CEC_ID_SET_SYSTEM_AUDIO_MODE] = {"Set System Audio Mode", 1, CEC_ADDR_BOTH,
+                                      handle_set_system_audio_mode, NULL},
+    [CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS] = {"Give System Audio Mode", 0, CEC_ADDR_DIRECTED,
+                                              handle_give_system_audio_mode_status, NULL},
+    [CEC_ID_SYSTEM_AUDIO_MODE_STATUS] = {"System Audio Mode Status", 1, CEC_ADDR_DIRECTED, NULL,
+                                         NULL},
+    [CEC_ID_REPORT_AUDIO_STATUS] = {"Report Audio Status", 1, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_ROUTING_CHANGE] = {"Routing Change", 4, CEC_ADDR_BROADCAST, handle_routing_change,
+                               decode_routing_change},
+    [CEC_ID_ACTIVE_SOURCE] = {"Active Source", 2, CEC_ADDR_BROADCAST, handle_active_source,
+                              decode_active_source},
+    [CEC_ID_GIVE_PHYSICAL_ADDRESS] = {"Give Physical Address", 0, CEC_ADDR_DIRECTED,
+                                      handle_give_physical_address, NULL},
+    [CEC_ID_REPORT_PHYSICAL_ADDRESS] = {"Report Physical Address", 3, CEC_ADDR_BROADCAST,
+                                        handle_report_physical_address, decode_physical_address},
+    [CEC_ID_REQUEST_ACTIVE_SOURCE] = {"Request Active Source", 0, CEC_ADDR_BROADCAST,
+                                      handle_request_active_source, NULL},
+    [CEC_ID_SET_STREAM_PATH] = {"Set Stream Path", 2, CEC_ADDR_BROADCAST, handle_set_stream_path,
+                                decode_physical_address},
+    [CEC_ID_DEVICE_VENDOR_ID] = {"Device Vendor ID", 3, CEC_ADDR_BROADCAST,
+                                 handle_device_vendor_id, NULL},
+    [CEC_ID_GIVE_DEVICE_VENDOR_ID] = {"Give Device Vendor ID", 0, CEC_ADDR_DIRECTED,
+                                      handle_give_device_vendor_id, NULL},
+    [CEC_ID_MENU_REQUEST] = {"Menu Request", 1, CEC_ADDR_DIRECTED, handle_menu_request,
+                             decode_operands},
+    [CEC_ID_MENU_STATUS] = {"Menu Status", 1, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_GIVE_DEVICE_POWER_STATUS] = {"Give Device Power Status", 0, CEC_ADDR_DIRECTED,
+                                         handle_give_device_power_status, NULL},
+    [CEC_ID_REPORT_POWER_STATUS] = {"Report Power Status", 1, CEC_ADDR_BOTH, NULL,
+                                    decode_power_status},
+    [CEC_ID_GET_MENU_LANGUAGE] = {"Get Menu Language", 0, CEC_ADDR_DIRECTED, handle_tv_only,
+                                  NULL},
+    [CEC_ID_INACTIVE_SOURCE] = {"Inactive Source", 2, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_CEC_VERSION] = {"CEC Version", 1, CEC_ADDR_DIRECTED, NULL, NULL},
+    [CEC_ID_GET_CEC_VERSION] = {"Get CEC Version", 0, CEC_ADDR_DIRECTED, handle_get_cec_version,
+                                NULL},
+    [CEC_ID_VENDOR_COMMAND_WITH_ID] = {"Vendor Command With ID", 3, CEC_ADDR_BOTH, NULL,
+                                       decode_operands},
+    [CEC_ID_GIVE_FEATURES] = {"Give Features", 0, CEC_ADDR_DIRECTED, handle_give_features, NULL},
+    [CEC_ID_REPORT_FEATURES] = {"Report Features", 4, CEC_ADDR_BROADCAST, NULL, decode_operands},
+    [CEC_ID_REQUEST_ARC_INITIATION] = {"Request ARC Initiation", 0, CEC_ADDR_DIRECTED,
+                                       handle_tv_only, NULL},
+    [CEC_ID_ABORT] = {"Abort", 0, CEC_ADDR_DIRECTED, handle_abort, NULL},
+};
+
+/**
+ * Check a received frame against the opcode table and run its handler.
+ *
+ * Frames for other devices are only counted. Frames for us that are too short
+ * or use the wrong addressing are ignored, unknown directed opcodes are
+ * aborted.
+ */
+static void dispatch(const uint8_t *pld, uint8_t pldcnt) {
+  uint8_t initiator = (pld[0] & 0xf0) >> 4;
+  uint8_t destination = pld[0] & 0x0f;
+  const cec_opcode_t *op = &cec_opcode[pld[1]];
+  cec_opcode_stats_t *stats = &opcode_stats[pld[1]];
+  cec_addressing_t addressing;
+
+  stats->rx++;
+
+  if (destination == 0x0f) {
+    addressing = CEC_ADDR_BROADCAST;
+  } else if ((laddr_mask >> destination) & 1) {
+    addressing = CEC_ADDR_DIRECTED;
+  } else {
+    return;
+  }
+
+  if (op->name == NULL) {
+    // never abort a broadcast
+    if (addressing == CEC_ADDR_DIRECTED) {
+      cec_feature_abort(destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+    }
+    return;
+  }
+
+  if (((op->addressing & addressing) == 0) || (pldcnt < (2 + op->operands))) {
+    stats->rejected++;
+    return;
+  }
+
+  if (op->handler != NULL) {
+    uint32_t start = time_us_32();
+    op->handler(initiator, destination, pld, pldcnt);
+    uint32_t elapsed = time_us_32() - start;
+
+    stats->handled++;
+    stats->handler_us += elapsed;
+    stats->handler_max_us = MAX(stats->handler_max_us, elapsed);
+  }
+}
+
 void cec_task(void *data) {
-  QueueHandle_t *q = (QueueHandle_t *)data;
+  hid_queue = (QueueHandle_t *)data;
 
   // load configuration
   nvs_load_config(&config);
-
-  // pause for EDID to settle
-  vTaskDelay(pdMS_TO_TICKS(config.edid_delay_ms));
+  nvs_task_init(&config, cec_bus_quiet);
+  reply_cache_update();
 
   gpio_init(CEC_PIN);
   gpio_disable_pulls(CEC_PIN);
   gpio_set_dir(CEC_PIN, GPIO_IN);
 
-  gpio_set_irq_callback(&hdmi_rx_frame_isr);
-  irq_set_enabled(IO_IRQ_BANK0, true);
-  gpio_set_irq_enabled(CEC_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
+  cec_log_set_format(format_cec_frame);
+
+  hdmi_rx_init();
+#if CEC_PHY_PIO
+  hdmi_tx_init();
+#endif
+  cec_tx_init();
+
+  // the DDC task waits for the EDID, the bus is up meanwhile
+  ddc_task_init(config.edid_delay_ms, xCECTask, NOTIFY_DDC);
 
-  paddr = get_physical_address(&config);
-  laddr = allocate_logical_address(&config);
+  // allocate once the physical address is known, receiving meanwhile
+  topology.pending = true;
+  topology.due = xTaskGetTickCount();
 
   while (true) {
-    uint8_t pld[16] = {0x0};
+    hdmi_frame_t *frame;
+    uint8_t *pld;
     uint8_t pldcnt;
     uint8_t initiator, destination;
-    uint8_t key = HID_KEY_NONE;
-    uint8_t no_active = 0;
-    (void) key;
 
-    pldcnt = recv_frame(pld, laddr);
+    uint16_t physical_address;
+    if (ddc_take_hotplug()) {
+      topology_hotplug();
+    }
+    if (ddc_take_physical_address(&physical_address)) {
+      topology_update(physical_address);
+    } else if (topology.pending && (topology_timeout() == 0)) {
+      topology_resolve();
+    }
+
+    frame = recv_frame(topology_timeout());
+    if (frame == NULL) {
+      continue;
+    }
+    pld = frame->message->data;
+    pldcnt = frame->message->len;
     // printf("pldcnt = %u\n", pldcnt);
     initiator = (pld[0] & 0xf0) >> 4;
     destination = pld[0] & 0x0f;
 
-    if ((pldcnt > 1)) {
-      switch (pld[1]) {
-        case CEC_ID_IMAGE_VIEW_ON:
-          break;
-        case CEC_ID_TEXT_VIEW_ON:
-          break;
-        case CEC_ID_STANDBY:
-          if (destination == laddr || destination == 0x0f) {
-            active_addr = 0x0000;
-            blink_set_blink(BLINK_STATE_BLUE_2HZ);
-          }
-          break;
-        case CEC_ID_SYSTEM_AUDIO_MODE_REQUEST:
-          if (destination == laddr) {
-            set_system_audio_mode(laddr, initiator, audio_status);
-          }
-          break;
-        case CEC_ID_GIVE_AUDIO_STATUS:
-          if (destination == laddr) {
-            report_audio_status(laddr, initiator, 0x32);  // volume 50%, mute off
-          }
-          break;
-        case CEC_ID_SET_SYSTEM_AUDIO_MODE:
-          if (destination == laddr || destination == 0x0f) {
-            audio_status = (pld[2] == 1);
-          }
-          break;
-        case CEC_ID_GIVE_SYSTEM_AUDIO_MODE_STATUS:
-          if (destination == laddr)
-            system_audio_mode_status(laddr, initiator, audio_status);
-          break;
-        case CEC_ID_SYSTEM_AUDIO_MODE_STATUS:
-          break;
-        case CEC_ID_ROUTING_CHANGE:
-          // uint16_t old_addr = (pld[2] << 8) | pld[3];
-          active_addr = (pld[4] << 8) | pld[5];
-          paddr = get_physical_address(&config);
-          laddr = allocate_logical_address(&config);
-          if (paddr == active_addr) {
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
-            no_active = 0;
-          }
-          break;
-        case CEC_ID_ACTIVE_SOURCE:
-          active_addr = (pld[2] << 8) | pld[3];
-          no_active = 0;
-          break;
-        case CEC_ID_REPORT_PHYSICAL_ADDRESS:
-          // On broadcast receive, do the same
-          if ((initiator == 0x00) && (destination == 0x0f)) {
-            paddr = get_physical_address(&config);
-            laddr = allocate_logical_address(&config);
-            if (paddr != 0x0000) {
-              report_physical_address(laddr, 0x0f, paddr, config.device_type);
-            }
-          }
-          break;
-        case CEC_ID_REQUEST_ACTIVE_SOURCE:
-          no_active++;
-          if (paddr == active_addr || no_active > 2) {
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
-            no_active = 0;
-          }
-          break;
-        case CEC_ID_SET_STREAM_PATH:
-          if (paddr == ((pld[2] << 8) | pld[3])) {
-            active_addr = paddr;
-            image_view_on(laddr, 0x00);
-            active_source(laddr, paddr);
-            no_active = 0;
-            blink_set_blink(BLINK_STATE_GREEN_2HZ);
-          }
-          break;
-        case CEC_ID_DEVICE_VENDOR_ID:
-          // On broadcast receive, do the same
-          if ((initiator == 0x00) && (destination == 0x0f)) {
-            device_vendor_id(laddr, 0x0f, 0x0010FA);
-          }
-          break;
-        case CEC_ID_GIVE_DEVICE_VENDOR_ID:
-          if (destination == laddr)
-            device_vendor_id(laddr, 0x0f, 0x0010FA);
-          break;
-        case CEC_ID_MENU_STATUS:
-          break;
-        case CEC_ID_GIVE_DEVICE_POWER_STATUS:
-          if (destination == laddr)
-            report_power_status(laddr, initiator, active_addr != paddr);
-#if 0
-          /* Hack for Google Chromecast to force it sending V+/V- if no CEC TV is present */
-          if (destination == 0)
-            report_power_status(0, initiator, 0x00);
-#endif
-          break;
-        case CEC_ID_REPORT_POWER_STATUS:
-          break;
-        case CEC_ID_GET_MENU_LANGUAGE:
-          break;
-        case CEC_ID_INACTIVE_SOURCE:
-          break;
-        case CEC_ID_CEC_VERSION:
-          break;
-        case CEC_ID_GET_CEC_VERSION:
-          if (destination == laddr) {
-            report_cec_version(laddr, initiator);
-          }
-          break;
-        case CEC_ID_GIVE_OSD_NAME:
-          if (destination == laddr)
-            set_osd_name(laddr, initiator);
-          break;
-        case CEC_ID_SET_OSD_NAME:
-          break;
-        case CEC_ID_GIVE_PHYSICAL_ADDRESS:
-          if (destination == laddr && paddr != 0x0000)
-            report_physical_address(laddr, 0x0f, paddr, config.device_type);
-          break;
-        case CEC_ID_USER_CONTROL_PRESSED:
-          if (destination == laddr) {
-            blink_set(BLINK_STATE_GREEN_ON);
-            command_t command = config.keymap[pld[2]];
-#ifdef DEBUG
-            char buffer[128];
-            snprintf(buffer, sizeof(buffer), "remote cec_key: 0x%02X\n", command.key);
-            tuh_cdc_write(0, buffer, strlen(buffer));
-            tuh_cdc_write_flush(0);
-#else
-            if (command.name != NULL) {
-              xQueueSend(*q, &command.key, pdMS_TO_TICKS(10));
-            }
-#endif
-          }
-          break;
-        case CEC_ID_USER_CONTROL_RELEASED:
-          if (destination == laddr) {
-            blink_set(BLINK_STATE_OFF);
-            key = HID_KEY_NONE;
-            //xQueueSend(*q, &key, pdMS_TO_TICKS(10));
-          }
-          break;
-        case CEC_ID_ABORT:
-          if (destination == laddr) {
-            cec_feature_abort(laddr, initiator, pld[1], CEC_ABORT_REFUSED);
-          }
-          break;
-        case CEC_ID_FEATURE_ABORT:
-          break;
-        case CEC_ID_VENDOR_COMMAND_WITH_ID:
-          break;
-        default:
-          if (destination == laddr) {
-            cec_feature_abort(laddr, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
-          }
-          break;
-      }
+    // another device sending from our address, polls for it are allocations
+    if (((laddr_mask >> initiator) & 1) && ((pldcnt > 1) || (destination != initiator))) {
+      laddr_cache[laddress_type(initiator)].conflict = true;
+      topology_changed(false, false);
+    }
+
+    if (pldcnt > 1) {
+      reply_to.valid = true;
+      reply_to.opcode = pld[1];
+      reply_to.end = frame->end;
+      dispatch(pld, pldcnt);
+      reply_to.valid = false;
     }
   }
 }
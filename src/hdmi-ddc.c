@@ -4,15 +4,59 @@
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include "crc/crc32.h"
+#include "hardware/dma.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
 #include "pico/stdlib.h"
 
 #include "cec-log.h"
+#include "edid.h"
 #include "hdmi-ddc.h"
 #include "usb-cdc.h"
 
+#define DDC_TASK_STACK_SIZE (1024)
+#define DDC_DMA_IRQ DMA_IRQ_1
+
+#define NOTIFY_DDC_REQUEST ((UBaseType_t)0)
+#define NOTIFY_DDC_DMA ((UBaseType_t)1)
+
+/* DDC is specified at 100kHz, most sinks also accept fast mode. */
+#define DDC_BAUDRATE_FAST (400 * 1000)
+#define DDC_BAUDRATE_STANDARD (100 * 1000)
+
+/* DDC task, owns the bus so EDID reads never block cec_task. */
+static TaskHandle_t xDDCTask;
+
+/* Bus speed, drops to standard mode if the sink fails a fast transfer. */
+static uint ddc_baudrate = DDC_BAUDRATE_FAST;
+
+/* Readiness probe backoff at boot. */
+#define DDC_PROBE_MIN_MS (10)
+#define DDC_PROBE_MAX_MS (500)
+
+/* Upper bound on the wait for the sink at boot. */
+static uint32_t ddc_ready_timeout_ms;
+
+/* Time since boot the sink answered with a valid EDID header, 0 if never. */
+static uint32_t ddc_ready_ms;
+
+static uint ddc_dma_cmd;
+static uint ddc_dma_data;
+
+/* Read commands fed to the I2C TX FIFO, one per byte. */
+static uint32_t ddc_cmds[EDID_BLOCK_SIZE];
+
+/* Pending request and its result, handed back to the requesting task. */
+static struct {
+  TaskHandle_t task;
+  UBaseType_t index;
+  volatile bool ready;
+  uint16_t address;
+} request;
+
 static void ddc_init() {
-  i2c_init(i2c_default, 100 * 1000);
+  i2c_init(i2c_default, ddc_baudrate);
   gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
   gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
   gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
@@ -23,149 +67,479 @@ static void ddc_exit() {
   i2c_deinit(i2c_default);
 }
 
-#define EDID_BLOCK_SIZE (128)
 #define EDID_I2C_TIMEOUT_US (100 * 1000)
 #define EDID_I2C_ADDR (0x50)
-#define EDID_I2C_READ_SIZE (EDID_BLOCK_SIZE * 2)
-#define EDID_CTA_DTD_START (0x02)
-#define EDID_CTA_DBC_OFFSET (0x04)
+#define EDID_SEGMENT_I2C_ADDR (0x30)
 
-const uint8_t header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
-const uint8_t ctahdr[2] = {0x02, 0x03};
-const uint8_t vsbhdr[3] = {0x03, 0x0c, 0x00};
+/*
+ * Bytes compared to revalidate the cache: the header, the extension count, the
+ * checksum of block 0 and the checksum of the block holding the HDMI VSDB.
+ */
+#define EDID_SIGNATURE_SIZE (EDID_HEADER_SIZE + 3)
+
+/* Parsed EDID, valid until a hot-plug or an explicit refresh. */
+static struct {
+  bool valid;
+  bool stale;     // revalidate with the header and checksums before use
+  bool refresh;   // skip the revalidation, read and parse the full EDID
+  uint32_t hash;  // combined CRC32 of the blocks read
+  uint16_t physical_address;
+  uint8_t block;  // block holding the HDMI VSDB
+  uint8_t signature[EDID_SIGNATURE_SIZE];
+} cache;
+
+static ddc_cache_stats_t cache_stats;
+
+/* State of a full read, passed to the block reader. */
+typedef struct {
+  uint32_t hash;
+  uint32_t read_us;
+  uint8_t signature[EDID_SIGNATURE_SIZE];  // last byte from the last block read
+} ddc_read_t;
+
+static void ddc_dma_isr(void) {
+  if (dma_channel_get_irq1_status(ddc_dma_data)) {
+    dma_channel_acknowledge_irq1(ddc_dma_data);
+    vTaskNotifyGiveIndexedFromISR(xDDCTask, NOTIFY_DDC_DMA, NULL);
+  }
+}
 
 /**
- * Calculate and verify EDID checksum.
+ * Claim the DMA channels, one feeds read commands and one drains the data.
  */
-static int verify(uint8_t *edid, size_t len) {
-  uint16_t cksum = 0x0000;
+static void ddc_dma_init(void) {
+  ddc_dma_cmd = dma_claim_unused_channel(true);
+  dma_channel_config c = dma_channel_get_default_config(ddc_dma_cmd);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, i2c_get_dreq(i2c_default, true));
+  dma_channel_configure(ddc_dma_cmd, &c, &i2c_get_hw(i2c_default)->data_cmd, ddc_cmds, 0, false);
+
+  ddc_dma_data = dma_claim_unused_channel(true);
+  c = dma_channel_get_default_config(ddc_dma_data);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_dreq(&c, i2c_get_dreq(i2c_default, false));
+  dma_channel_configure(ddc_dma_data, &c, NULL, &i2c_get_hw(i2c_default)->data_cmd, 0, false);
+
+  irq_set_exclusive_handler(DDC_DMA_IRQ, &ddc_dma_isr);
+  dma_channel_set_irq1_enabled(ddc_dma_data, true);
+  irq_set_enabled(DDC_DMA_IRQ, true);
+}
 
-  // log the data
-  if ((len % 8) == 0) {
-    for (size_t i = 0; i < len; i += 8) {
-      cec_log_submitf("[%d] %02x %02x %02x %02x %02x %02x %02x %02x"_CDC_BR, i, edid[i],
-                      edid[i + 1], edid[i + 2], edid[i + 3], edid[i + 4], edid[i + 5], edid[i + 6],
-                      edid[i + 7]);
-    }
-  } else {
-    for (size_t i = 0; i < len; i++) {
-      cec_log_submitf("[%d] %02x"_CDC_BR, i, edid[i]);
-    }
-  }
+/**
+ * Read len bytes by DMA, continuing the transfer started by the offset write.
+ *
+ * The DDC task sleeps until the last byte arrives, or gives up once the
+ * transfer took twice as long as it should. A sink that NACKs stops the
+ * transfer short, which shows as a timeout with the abort flag set.
+ */
+static int read_dma(uint8_t *data, size_t len) {
+  i2c_hw_t *hw = i2c_get_hw(i2c_default);
+  int ret = PICO_ERROR_NONE;
 
-  // calculate the checksum
   for (size_t i = 0; i < len; i++) {
-    cksum += edid[i];
+    ddc_cmds[i] = I2C_IC_DATA_CMD_CMD_BITS;
   }
+  ddc_cmds[0] |= I2C_IC_DATA_CMD_RESTART_BITS;
+  ddc_cmds[len - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+  // 9 clocks per byte
+  uint32_t timeout_us = ((len * 9 * 1000000) / ddc_baudrate) * 2 + 1000;
+
+  // drop a completion left over from an aborted transfer
+  ulTaskNotifyValueClearIndexed(NULL, NOTIFY_DDC_DMA, UINT32_MAX);
+
+  hw->dma_cr = I2C_IC_DMA_CR_RDMAE_BITS | I2C_IC_DMA_CR_TDMAE_BITS;
+  dma_channel_set_write_addr(ddc_dma_data, data, false);
+  dma_channel_set_trans_count(ddc_dma_data, len, true);
+  dma_channel_set_read_addr(ddc_dma_cmd, ddc_cmds, false);
+  dma_channel_set_trans_count(ddc_dma_cmd, len, true);
 
-  return ((cksum & 0x00ff) == 0x00 ? PICO_ERROR_NONE : PICO_ERROR_GENERIC);
+  TickType_t timeout = pdMS_TO_TICKS((timeout_us + 999) / 1000) + 1;
+  if ((ulTaskNotifyTakeIndexed(NOTIFY_DDC_DMA, pdTRUE, timeout) == 0) ||
+      (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)) {
+    ret = PICO_ERROR_GENERIC;
+  }
+
+  if (ret) {
+    // aborting may raise the completion interrupt (RP2040-E13)
+    dma_channel_set_irq1_enabled(ddc_dma_data, false);
+    dma_channel_abort(ddc_dma_cmd);
+    dma_channel_abort(ddc_dma_data);
+    dma_channel_acknowledge_irq1(ddc_dma_data);
+    dma_channel_set_irq1_enabled(ddc_dma_data, true);
+    (void)hw->clr_tx_abrt;
+  }
+  hw->dma_cr = 0;
+  i2c_default->restart_on_next = false;
+
+  return ret;
 }
 
 /**
- * Read a 256 byte block and verify the EDID block checksums.
+ * Read from an EDID block, selecting the E-DDC segment for blocks past 1.
  */
-static int read_edid_block(uint8_t *edid, size_t len) {
-  int ret = i2c_read_timeout_us(i2c_default, EDID_I2C_ADDR, edid, len, false, EDID_I2C_TIMEOUT_US);
-  if (ret != len) {
-    cec_log_submitf("Failed to read %d bytes from 0x%02x"_CDC_BR, len, EDID_I2C_ADDR);
+static int read_edid(uint8_t block, uint8_t offset, uint8_t *data, size_t len) {
+  uint8_t segment = block >> 1;
+  uint8_t start = ((block & 0x01) * EDID_BLOCK_SIZE) + offset;
+  int ret;
+
+  if (segment > 0) {
+    // the segment pointer is reset by the stop condition
+    ret = i2c_write_timeout_us(i2c_default, EDID_SEGMENT_I2C_ADDR, &segment, 1, true,
+                               EDID_I2C_TIMEOUT_US);
+    if (ret != 1) {
+      CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to write E-DDC segment %u"_CDC_BR, segment);
+      return PICO_ERROR_GENERIC;
+    }
+  }
+
+  ret = i2c_write_timeout_us(i2c_default, EDID_I2C_ADDR, &start, 1, true, EDID_I2C_TIMEOUT_US);
+  if (ret != 1) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to write DDC offset: %s"_CDC_BR,
+                  ret == PICO_ERROR_TIMEOUT ? "timeout" : "generic");
     return PICO_ERROR_GENERIC;
   }
 
-  if (verify(edid, len)) {
-    cec_log_submitf("Failed to verify EDID block checksum"_CDC_BR);
+  if (read_dma(data, len)) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to read %d bytes from 0x%02x"_CDC_BR, len, EDID_I2C_ADDR);
     return PICO_ERROR_GENERIC;
   }
 
-  cec_log_submitf("Read %d bytes from 0x%02x"_CDC_BR, ret, EDID_I2C_ADDR);
+  return PICO_ERROR_NONE;
+}
+
+/**
+ * Read and verify one EDID block for the parser.
+ */
+static int read_edid_block(uint8_t block, uint8_t *data, void *ctx) {
+  ddc_read_t *read = (ddc_read_t *)ctx;
+  uint64_t start = time_us_64();
+
+  int ret = read_edid(block, 0, data, EDID_BLOCK_SIZE);
+  read->read_us += time_us_64() - start;
+  if (ret) {
+    return ret;
+  }
+
+  // log the data
+  if (CEC_LOG_ON(CEC_LOG_LEVEL_DEBUG, CEC_LOG_DDC)) {
+    for (size_t i = 0; i < EDID_BLOCK_SIZE; i += 8) {
+      cec_log_submitf("[%u:%d] %02x %02x %02x %02x %02x %02x %02x %02x"_CDC_BR, block, i, data[i],
+                      data[i + 1], data[i + 2], data[i + 3], data[i + 4], data[i + 5], data[i + 6],
+                      data[i + 7]);
+    }
+  }
+
+  if (!edid_block_valid(data)) {
+    CEC_LOG_ERROR(CEC_LOG_DDC, "Failed to verify EDID block %u checksum"_CDC_BR, block);
+    return PICO_ERROR_GENERIC;
+  }
+
+  if (block == 0) {
+    memcpy(read->signature, data, EDID_HEADER_SIZE);
+    read->signature[EDID_HEADER_SIZE + 0] = data[EDID_EXTENSIONS];
+    read->signature[EDID_HEADER_SIZE + 1] = data[EDID_CHECKSUM];
+  }
+  // the search stops at the block holding the VSDB
+  read->signature[EDID_HEADER_SIZE + 2] = data[EDID_CHECKSUM];
+  read->hash = (read->hash * 31) + crc32(data, EDID_BLOCK_SIZE);
 
   return PICO_ERROR_NONE;
 }
 
 /**
- * Parse a data block and return the physical address if found.
+ * Check the cached EDID against the sink, reading only the header and
+ * checksums.
  *
- * Returns 0x0000 if the block is not a vendor specific data block or the
- * physical address is not found.
+ * Any change to a block changes its checksum, bar a 1 in 256 collision which
+ * an explicit refresh resolves.
+ */
+static bool revalidate(void) {
+  uint8_t signature[EDID_SIGNATURE_SIZE];
+
+  if (read_edid(0, 0, signature, EDID_HEADER_SIZE) ||
+      read_edid(0, EDID_EXTENSIONS, &signature[EDID_HEADER_SIZE], 2) ||
+      read_edid(cache.block, EDID_CHECKSUM, &signature[EDID_HEADER_SIZE + 2], 1)) {
+    CEC_LOG_WARN(CEC_LOG_DDC, "Failed to revalidate EDID"_CDC_BR);
+    return false;
+  }
+
+  return memcmp(signature, cache.signature, EDID_SIGNATURE_SIZE) == 0;
+}
+
+/**
+ * Read and parse the EDID, caching the result.
  */
-static uint16_t find_physical_address(uint8_t *block, size_t len) {
-  if (len < 4) {
-    // Too short for Vendor Specific Data Block
+static uint16_t read_physical_address(void) {
+  ddc_read_t read = {0};
+  uint16_t address = 0x0000;
+  uint8_t block = 0;
+
+  uint64_t start = time_us_64();
+  if (!edid_find_physical_address(read_edid_block, &read, &address, &block)) {
+    cache.valid = false;
     return 0x0000;
   }
+  cache_stats.read_us = read.read_us;
+  cache_stats.parse_us = (time_us_64() - start) - read.read_us;
+
+  if (!cache.valid || (read.hash != cache.hash)) {
+    cache_stats.changes++;
+  }
 
-  if (memcmp(&block[1], vsbhdr, 3) == 0) {
-    // HDMI Licensing, LLC block
-    uint16_t addr = (block[4] << 8) | block[3];
-    cec_log_submitf("  physical address = %04x"_CDC_BR, addr);
-    return addr;
+  if (block == 0) {
+    // no VSDB, only block 0 is revalidated
+    read.signature[EDID_HEADER_SIZE + 2] = read.signature[EDID_HEADER_SIZE + 1];
   }
 
-  return 0x0000;
+  cache.valid = true;
+  cache.hash = read.hash;
+  cache.physical_address = address;
+  cache.block = block;
+  memcpy(cache.signature, read.signature, EDID_SIGNATURE_SIZE);
+
+  return address;
 }
 
+/**
+ * Get the physical address, from the cache where possible.
+ */
 static uint16_t get_physical_address(void) {
-  uint8_t edid[EDID_I2C_READ_SIZE] = {0};
+  uint16_t address = 0x0000;
+  bool stale, refresh;
+
+  taskENTER_CRITICAL();
+  stale = cache.stale;
+  refresh = cache.refresh;
+  cache.stale = false;
+  cache.refresh = false;
+  taskEXIT_CRITICAL();
+
+  if (cache.valid && !stale && !refresh) {
+    cache_stats.hits++;
+    return cache.physical_address;
+  }
 
-  if (read_edid_block(edid, EDID_I2C_READ_SIZE)) {
-    return 0x0000;
+  if (refresh) {
+    // give a new sink another chance at fast mode
+    ddc_baudrate = DDC_BAUDRATE_FAST;
   }
 
-  if (memcmp(edid, header, 8)) {
-    // not an EDID block
-    return 0x0000;
+  ddc_init();
+
+  if (cache.valid && !refresh && revalidate()) {
+    cache_stats.hits++;
+    cache_stats.checks++;
+    address = cache.physical_address;
+  } else {
+    cache_stats.misses++;
+    address = read_physical_address();
+    if (!cache.valid && (ddc_baudrate == DDC_BAUDRATE_FAST)) {
+      CEC_LOG_WARN(CEC_LOG_DDC, "EDID read failed in fast mode, retrying at 100kHz"_CDC_BR);
+      ddc_baudrate = DDC_BAUDRATE_STANDARD;
+      i2c_set_baudrate(i2c_default, ddc_baudrate);
+      address = read_physical_address();
+    }
   }
 
-  cec_log_submitf(" EDID header"_CDC_BR);
-  if (edid[126] == 0x00) {
-    cec_log_submitf("Missing CTA extensions"_CDC_BR);
-    return 0x0000;
+  ddc_exit();
+
+  return address;
+}
+
+/**
+ * Check the sink answers at the EDID address with a valid header.
+ */
+static bool probe(void) {
+  uint8_t data[EDID_HEADER_SIZE];
+
+#ifdef PICO_DEFAULT_HDMI_HPD_PIN
+  if (!gpio_get(PICO_DEFAULT_HDMI_HPD_PIN)) {
+    return false;
   }
+#endif
+
+  ddc_init();
+  bool ready = (read_edid(0, 0, data, EDID_HEADER_SIZE) == PICO_ERROR_NONE) &&
+               edid_header_valid(data);
+  ddc_exit();
+
+  return ready;
+}
 
-  uint8_t *cta = &edid[EDID_BLOCK_SIZE];
-  if (memcmp(cta, ctahdr, 2) == 0) {
-    // Valid CTA extension block
-    cec_log_submitf(" CTA Extension"_CDC_BR);
-    cec_log_submitf("    DTD start: 0x%02x"_CDC_BR, cta[EDID_CTA_DTD_START]);
-
-    uint8_t offset = EDID_CTA_DBC_OFFSET;
-    for (uint8_t i = offset; i < cta[EDID_CTA_DTD_START];) {
-      uint8_t *db = &cta[i];
-      uint8_t len = (db[0] & 0x1f);
-      cec_log_submitf("  [%u](%u) data block: %02x"_CDC_BR, i, len, db[0]);
-      if (len == 0x00) {
-        i++;
-        continue;
-      }
-
-      uint16_t addr = find_physical_address(db, len);
-      if (addr != 0x0000) {
-        return addr;
-      }
-
-      i += len + 1;  // payload + header
+/**
+ * Wait for the sink's EDID, probing with exponential backoff.
+ *
+ * The source also reads the EDID at power up, backing off keeps our probes
+ * out of its way. Gives up after ddc_ready_timeout_ms, the first read is then
+ * attempted anyway.
+ */
+static void wait_ready(void) {
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(ddc_ready_timeout_ms);
+  TickType_t delay = pdMS_TO_TICKS(DDC_PROBE_MIN_MS);
+
+  while (!probe()) {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+      CEC_LOG_WARN(CEC_LOG_DDC, "EDID not ready after %" PRIu32 " ms"_CDC_BR, ddc_ready_timeout_ms);
+      return;
     }
+    vTaskDelay(MIN(delay, timeout - elapsed));
+    delay = MIN(delay * 2, pdMS_TO_TICKS(DDC_PROBE_MAX_MS));
   }
 
-  return 0x0000;
+  ddc_ready_ms = time_us_64() / 1000;
+  CEC_LOG_INFO(CEC_LOG_DDC, "EDID ready %" PRIu32 " ms after boot"_CDC_BR, ddc_ready_ms);
 }
 
-uint16_t ddc_get_physical_address(void) {
-  uint8_t zero = 0x00;
-  uint16_t address = 0x0000;
+#ifdef PICO_DEFAULT_HDMI_HPD_PIN
+/* HPD must be stable this long to count, a sink signals a change with a 100ms low pulse. */
+#define HPD_DEBOUNCE_MS (100)
 
-  ddc_init();
+static alarm_id_t hpd_alarm = 0;
 
-  cec_log_submitf("%s"_CDC_BR, "Issuing DDC reset");
-  // issue a DDC reset
-  int ret = i2c_write_timeout_us(i2c_default, EDID_I2C_ADDR, &zero, 1, true, EDID_I2C_TIMEOUT_US);
-  if (ret != 1) {
-    cec_log_submitf("Failed to write DDC reset: %s"_CDC_BR,
-                    ret == PICO_ERROR_TIMEOUT ? "timeout" : "generic");
-    return 0x0000;
+/* Debounced HPD level. */
+static bool hpd_level = false;
+
+/* Plug events are only reported once the first EDID read covers the sink. */
+static volatile bool hpd_armed = false;
+
+static volatile bool hpd_plugged = false;
+
+/* Task notified of plug events. */
+static TaskHandle_t hpd_task;
+static UBaseType_t hpd_index;
+
+static int64_t hpd_debounce(alarm_id_t alarm, void *user_data) {
+  bool level = gpio_get(PICO_DEFAULT_HDMI_HPD_PIN);
+
+  hpd_alarm = 0;
+  if (level != hpd_level) {
+    hpd_level = level;
+    if (level && hpd_armed) {
+      hpd_plugged = true;
+      vTaskNotifyGiveIndexedFromISR(hpd_task, hpd_index, NULL);
+    }
   }
 
-  address = get_physical_address();
-  ddc_exit();
+  return 0;
+}
 
-  return address;
+/**
+ * Restart the debounce on every HPD edge.
+ */
+static void hpd_isr(void) {
+  uint32_t events = gpio_get_irq_event_mask(PICO_DEFAULT_HDMI_HPD_PIN);
+
+  if (events == 0) {
+    return;
+  }
+  gpio_acknowledge_irq(PICO_DEFAULT_HDMI_HPD_PIN, events);
+
+  if (hpd_alarm > 0) {
+    cancel_alarm(hpd_alarm);
+  }
+  hpd_alarm = add_alarm_in_ms(HPD_DEBOUNCE_MS, hpd_debounce, NULL, true);
+}
+
+/**
+ * Watch HPD, sharing the GPIO bank interrupt with the CEC receiver's raw handler.
+ */
+static void hpd_init(void) {
+  gpio_init(PICO_DEFAULT_HDMI_HPD_PIN);
+  gpio_set_dir(PICO_DEFAULT_HDMI_HPD_PIN, GPIO_IN);
+  gpio_pull_down(PICO_DEFAULT_HDMI_HPD_PIN);
+  hpd_level = gpio_get(PICO_DEFAULT_HDMI_HPD_PIN);
+
+  gpio_add_raw_irq_handler(PICO_DEFAULT_HDMI_HPD_PIN, &hpd_isr);
+  gpio_set_irq_enabled(PICO_DEFAULT_HDMI_HPD_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+}
+#endif
+
+static void ddc_task(void *param) {
+  ddc_dma_init();
+  wait_ready();
+#ifdef PICO_DEFAULT_HDMI_HPD_PIN
+  hpd_armed = true;
+#endif
+
+  while (true) {
+    ulTaskNotifyTakeIndexed(NOTIFY_DDC_REQUEST, pdTRUE, portMAX_DELAY);
+
+    request.address = get_physical_address();
+    request.ready = true;
+    xTaskNotifyGiveIndexed(request.task, request.index);
+  }
+}
+
+void ddc_task_init(uint32_t ready_timeout_ms,
+                   TaskHandle_t hotplug_task,
+                   UBaseType_t hotplug_index) {
+  static StaticTask_t ddc_task_static;
+  static StackType_t ddc_stack[DDC_TASK_STACK_SIZE];
+
+  ddc_ready_timeout_ms = ready_timeout_ms;
+#ifdef PICO_DEFAULT_HDMI_HPD_PIN
+  hpd_task = hotplug_task;
+  hpd_index = hotplug_index;
+  hpd_init();
+#else
+  (void)hotplug_task;
+  (void)hotplug_index;
+#endif
+
+  xDDCTask = xTaskCreateStatic(ddc_task, "ddc", DDC_TASK_STACK_SIZE, NULL,
+                               configMAX_PRIORITIES - 4, &ddc_stack[0], &ddc_task_static);
+}
+
+void ddc_request_physical_address(TaskHandle_t task, UBaseType_t index) {
+  request.task = task;
+  request.index = index;
+  request.ready = false;
+  xTaskNotifyGiveIndexed(xDDCTask, NOTIFY_DDC_REQUEST);
+}
+
+bool ddc_take_physical_address(uint16_t *address) {
+  if (!request.ready) {
+    return false;
+  }
+
+  request.ready = false;
+  *address = request.address;
+
+  return true;
+}
+
+void ddc_refresh(bool full) {
+  taskENTER_CRITICAL();
+  cache.stale = true;
+  cache.refresh |= full;
+  taskEXIT_CRITICAL();
+}
+
+bool ddc_take_hotplug(void) {
+#ifdef PICO_DEFAULT_HDMI_HPD_PIN
+  if (hpd_plugged) {
+    hpd_plugged = false;
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+uint32_t ddc_get_ready_ms(void) {
+  return ddc_ready_ms;
+}
+
+void ddc_get_cache_stats(ddc_cache_stats_t *stats) {
+  taskENTER_CRITICAL();
+  *stats = cache_stats;
+  taskEXIT_CRITICAL();
 }
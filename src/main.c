@@ -10,6 +10,7 @@
 
 #include "blink.h"
 #include "cec-log.h"
+#include "cec-monitor.h"
 #include "hdmi-cec.h"
 #include "usb-cdc.h"
 #include "ws2812.h"
@@ -66,6 +67,9 @@ int main() {
   (void)xUSBDTask;
 
   cec_log_init();
+#if CEC_MONITOR
+  cec_monitor_init();
+#endif
 
   vTaskStartScheduler();
 
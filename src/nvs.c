@@ -1,13 +1,19 @@
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <hardware/flash.h>
 #include <hardware/sync.h>
 
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "crc/crc32.h"
 
 #include "cec-config.h"
+#include "cec-log.h"
 #include "nvs.h"
+#include "usb-cdc.h"
 
 /**
  * Configuration header block, fixed size (40 bytes).
@@ -37,6 +43,31 @@ typedef struct __attribute__((packed)) {
   uint8_t keymap[UINT8_MAX];
 } cec_config_nvs_v1_t;
 
+/**
+ * CEC configuration block NVS representation (version 2)
+ *
+ * Structure is packed to ensure checksum correctness.
+ */
+typedef struct __attribute__((packed)) {
+  /** DDC EDID delay in milliseconds. */
+  uint32_t edid_delay_ms;
+
+  /** CEC physical address. */
+  uint16_t physical_address;
+
+  /** CEC logical address (unused). */
+  uint8_t logical_address;
+
+  /** CEC device type (unused). */
+  uint8_t device_type;
+
+  /** Keymap. */
+  cec_config_keymap_t keymap_type;
+
+  /** User Control key mapping table. */
+  uint8_t keymap[UINT8_MAX];
+} cec_config_nvs_v2_t;
+
 /**
  * CEC configuration block NVS representation.
  *
@@ -55,11 +86,32 @@ typedef struct __attribute__((packed)) {
   /** CEC device type (unused). */
   uint8_t device_type;
 
+  /** Device types claimed besides device_type, a bit per type. */
+  uint8_t extra_device_types;
+
   /** Keymap. */
   cec_config_keymap_t keymap_type;
 
   /** User Control key mapping table. */
   uint8_t keymap[UINT8_MAX];
+
+  /** Last allocated logical addresses, a bit per address. */
+  uint16_t last_logical_addresses;
+
+  /** Receive timing preset. */
+  uint8_t rx_timing_type;
+
+  /** Receive acceptance windows, for the custom preset. */
+  cec_config_rx_timing_t rx_timing;
+
+  /** Learnt receive window shifts per initiator. */
+  cec_config_rx_offset_t rx_offset[16];
+
+  /** OSD name, NUL terminated. */
+  char osd_name[CEC_CONFIG_OSD_NAME_LEN + 1];
+
+  /** IEEE OUI reported as the vendor ID. */
+  uint32_t vendor_id;
 } cec_config_nvs_t;
 
 /**
@@ -87,8 +139,7 @@ extern uint32_t __CEC_NVS_LEN[];
 
 #define CEC_NVS_LEN ((uint32_t)(&__CEC_NVS_LEN))
 
-const uint8_t CEC_CONFIG_VERSION_01 = 0x01;
-const uint8_t CEC_CONFIG_VERSION = 0x02;
+const uint8_t CEC_CONFIG_VERSION = 0x03;
 const size_t CEC_CONFIG_SIZE = sizeof(cec_config_t);
 
 static uint32_t nvs_get_flash_address(void) {
@@ -96,47 +147,125 @@ static uint32_t nvs_get_flash_address(void) {
 }
 
 /**
- * Migrate v1 config to current config.
+ * Check the CRC of an older, shorter, config block.
+ *
+ * The CRC follows the block at its 4 byte alignment, so it is not at
+ * nvs->config_crc.
  */
-static bool migrate_v1(const pico_cec_nvs_t *nvs, cec_config_t *config) {
-  if (crc32((unsigned char *)&nvs->config, sizeof(cec_config_nvs_v1_t)) == nvs->config_crc) {
-    cec_config_nvs_v1_t *configv1 = (cec_config_nvs_v1_t *)&nvs->config;
-    // deserialise and migrate
-    config->edid_delay_ms = configv1->edid_delay_ms;
-    config->physical_address = configv1->physical_address;
-    for (uint8_t n = 0; n < UINT8_MAX; n++) {
-      config->keymap[n].key = configv1->keymap[n];
-    }
+static bool config_crc_valid(const pico_cec_nvs_t *nvs, size_t size) {
+  const uint8_t *config = (const uint8_t *)&nvs->config;
+  size_t offset = offsetof(pico_cec_nvs_t, config) + size;
+  uint32_t crc;
 
-    return true;
-  }
+  offset = (offset + sizeof(crc) - 1) & ~(sizeof(crc) - 1);
+  memcpy(&crc, (const uint8_t *)nvs + offset, sizeof(crc));
 
-  return false;
+  return crc32((unsigned char *)config, size) == crc;
 }
 
 /**
- * Load current config.
+ * Where a config block version keeps each field, 0 if it has none.
+ *
+ * Every version starts with the EDID delay and physical address and has a
+ * keymap, no other field is ever at the start of the block.
  */
-static bool load_config(pico_cec_nvs_t *nvs, cec_config_t *config) {
-  if (crc32((unsigned char *)&nvs->config, sizeof(nvs->config)) == nvs->config_crc) {
-    // deserialise
-    config->edid_delay_ms = nvs->config.edid_delay_ms;
-    config->physical_address = nvs->config.physical_address;
-    config->logical_address = nvs->config.logical_address;
-    config->device_type = nvs->config.device_type;
+typedef struct {
+  uint16_t size;
+  uint16_t keymap;
+  uint16_t logical_address;
+  uint16_t device_type;
+  uint16_t extra_device_types;
+  uint16_t keymap_type;
+  uint16_t last_logical_addresses;
+  uint16_t rx_timing_type;
+  uint16_t rx_timing;
+  uint16_t rx_offset;
+  uint16_t osd_name;
+  uint16_t vendor_id;
+} nvs_layout_t;
+
+#define NVS_LAYOUT_COMMON(type)                                                          \
+  .size = sizeof(type), .keymap = offsetof(type, keymap),                                \
+  .logical_address = offsetof(type, logical_address),                                    \
+  .device_type = offsetof(type, device_type), .keymap_type = offsetof(type, keymap_type)
+
+/* Config block layouts, indexed by version - 1, the last is CEC_CONFIG_VERSION. */
+static const nvs_layout_t nvs_layouts[] = {
+    {
+        .size = sizeof(cec_config_nvs_v1_t),
+        .keymap = offsetof(cec_config_nvs_v1_t, keymap),
+    },
+    {
+        NVS_LAYOUT_COMMON(cec_config_nvs_v2_t),
+    },
+    {
+        NVS_LAYOUT_COMMON(cec_config_nvs_t),
+        .extra_device_types = offsetof(cec_config_nvs_t, extra_device_types),
+        .last_logical_addresses = offsetof(cec_config_nvs_t, last_logical_addresses),
+        .rx_timing_type = offsetof(cec_config_nvs_t, rx_timing_type),
+        .rx_timing = offsetof(cec_config_nvs_t, rx_timing),
+        .rx_offset = offsetof(cec_config_nvs_t, rx_offset),
+        .osd_name = offsetof(cec_config_nvs_t, osd_name),
+        .vendor_id = offsetof(cec_config_nvs_t, vendor_id),
+    },
+};
+
+/**
+ * Deserialise a config block of any version, fields it lacks keep their
+ * defaults.
+ */
+static bool load_config(const pico_cec_nvs_t *nvs,
+                        const nvs_layout_t *layout,
+                        cec_config_t *config) {
+  const uint8_t *block = (const uint8_t *)&nvs->config;
+  const cec_config_nvs_v1_t *common = (const cec_config_nvs_v1_t *)block;
+
+  if (!config_crc_valid(nvs, layout->size)) {
+    return false;
+  }
+
+  config->edid_delay_ms = common->edid_delay_ms;
+  config->physical_address = common->physical_address;
+  for (uint8_t n = 0; n < UINT8_MAX; n++) {
+    config->keymap[n].key = block[layout->keymap + n];
+  }
+  if (layout->logical_address) {
+    config->logical_address = block[layout->logical_address];
+  }
+  if (layout->device_type) {
+    config->device_type = block[layout->device_type];
     // hack to support previous unused setting
     if (config->device_type == CEC_CONFIG_DEVICE_TYPE_TV) {
       config->device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
     }
-    config->keymap_type = nvs->config.keymap_type;
-    for (uint8_t n = 0; n < UINT8_MAX; n++) {
-      config->keymap[n].key = nvs->config.keymap[n];
-    }
-
-    return true;
+  }
+  if (layout->extra_device_types) {
+    config->extra_device_types = block[layout->extra_device_types];
+  }
+  if (layout->keymap_type) {
+    memcpy(&config->keymap_type, block + layout->keymap_type, sizeof(config->keymap_type));
+  }
+  if (layout->last_logical_addresses) {
+    memcpy(&config->last_logical_addresses, block + layout->last_logical_addresses,
+           sizeof(config->last_logical_addresses));
+  }
+  if (layout->rx_timing_type) {
+    config->rx_timing_type = block[layout->rx_timing_type];
+  }
+  if (layout->rx_timing) {
+    memcpy(&config->rx_timing, block + layout->rx_timing, sizeof(config->rx_timing));
+  }
+  if (layout->rx_offset) {
+    memcpy(config->rx_offset, block + layout->rx_offset, sizeof(config->rx_offset));
+  }
+  if (layout->osd_name) {
+    memcpy(config->osd_name, block + layout->osd_name, sizeof(config->osd_name));
+  }
+  if (layout->vendor_id) {
+    memcpy(&config->vendor_id, block + layout->vendor_id, sizeof(config->vendor_id));
   }
 
-  return false;
+  return true;
 }
 
 bool nvs_read_config(cec_config_t *config) {
@@ -150,11 +279,14 @@ bool nvs_read_config(cec_config_t *config) {
 
   // read and check header/config CRCs
   if (crc32((unsigned char *)&cec_nvs->header, sizeof(cec_nvs->header)) == cec_nvs->header_crc) {
-    if (cec_nvs->header.version == CEC_CONFIG_VERSION_01) {
-      success = migrate_v1(cec_nvs, config);
-    } else if (cec_nvs->header.version == CEC_CONFIG_VERSION) {
-      success = load_config(cec_nvs, config);
+    uint8_t version = cec_nvs->header.version;
+    if ((version >= 1) && (version <= (sizeof(nvs_layouts) / sizeof(nvs_layouts[0])))) {
+      success = load_config(cec_nvs, &nvs_layouts[version - 1], config);
     }
+    CEC_LOG_INFO(CEC_LOG_NVS, "Configuration version %u %s"_CDC_BR, cec_nvs->header.version,
+                 success ? "loaded" : "rejected");
+  } else {
+    CEC_LOG_INFO(CEC_LOG_NVS, "No saved configuration, using defaults"_CDC_BR);
   }
 
   return success;
@@ -175,49 +307,137 @@ void nvs_load_config(cec_config_t *config) {
       break;
   }
 
+  cec_config_set_rx_timing(config);
   cec_config_complete(config);
 
   return;
 }
 
-bool nvs_save_config(const cec_config_t *config) {
-  pico_cec_nvs_t cec_nvs = {0x0};
-
-  if (sizeof(cec_nvs) > CEC_NVS_LEN) {
-    return false;
-  }
+/**
+ * Serialise and checksum the configuration.
+ */
+static void nvs_serialise(const cec_config_t *config, pico_cec_nvs_t *cec_nvs) {
+  memset(cec_nvs, 0, sizeof(*cec_nvs));
 
   // serialise and checksum header
-  cec_nvs.header.version = CEC_CONFIG_VERSION;
-  cec_nvs.header.length = CEC_CONFIG_SIZE;
-  cec_nvs.header_crc = crc32((unsigned char *)&cec_nvs.header, sizeof(cec_nvs.header));
+  cec_nvs->header.version = CEC_CONFIG_VERSION;
+  cec_nvs->header.length = CEC_CONFIG_SIZE;
+  cec_nvs->header_crc = crc32((unsigned char *)&cec_nvs->header, sizeof(cec_nvs->header));
 
   // serialise and checksum config
-  cec_nvs.config.edid_delay_ms = config->edid_delay_ms;
-  cec_nvs.config.physical_address = config->physical_address;
-  cec_nvs.config.logical_address = config->logical_address;
-  cec_nvs.config.device_type = config->device_type;
-  cec_nvs.config.keymap_type = config->keymap_type;
+  cec_nvs->config.edid_delay_ms = config->edid_delay_ms;
+  cec_nvs->config.physical_address = config->physical_address;
+  cec_nvs->config.logical_address = config->logical_address;
+  cec_nvs->config.device_type = config->device_type;
+  cec_nvs->config.extra_device_types = config->extra_device_types;
+  cec_nvs->config.keymap_type = config->keymap_type;
 
   for (unsigned int n = 0; n < UINT8_MAX; n++) {
-    cec_nvs.config.keymap[n] = config->keymap[n].key;
+    cec_nvs->config.keymap[n] = config->keymap[n].key;
   }
+  cec_nvs->config.last_logical_addresses = config->last_logical_addresses;
+  cec_nvs->config.rx_timing_type = config->rx_timing_type;
+  cec_nvs->config.rx_timing = config->rx_timing;
+  memcpy(cec_nvs->config.rx_offset, config->rx_offset, sizeof(cec_nvs->config.rx_offset));
+  memcpy(cec_nvs->config.osd_name, config->osd_name, sizeof(cec_nvs->config.osd_name));
+  cec_nvs->config.vendor_id = config->vendor_id;
+
+  cec_nvs->config_crc = crc32((unsigned char *)&cec_nvs->config, sizeof(cec_nvs->config));
+}
 
-  cec_nvs.config_crc = crc32((unsigned char *)&cec_nvs.config, sizeof(cec_nvs.config));
-
+/**
+ * Erase and program the configuration sectors.
+ */
+static void nvs_program(const pico_cec_nvs_t *cec_nvs) {
   // minimum number of flash sectors to erase in bytes
-  unsigned int n = sizeof(cec_nvs) / FLASH_SECTOR_SIZE;
-  unsigned int size = sizeof(cec_nvs) % FLASH_SECTOR_SIZE == 0 ? n * FLASH_SECTOR_SIZE
-                                                               : (n + 1) * FLASH_SECTOR_SIZE;
+  unsigned int n = sizeof(*cec_nvs) / FLASH_SECTOR_SIZE;
+  unsigned int size = sizeof(*cec_nvs) % FLASH_SECTOR_SIZE == 0 ? n * FLASH_SECTOR_SIZE
+                                                                : (n + 1) * FLASH_SECTOR_SIZE;
 
   // interrupts must be disabled to safely program flash
   uint32_t irqs = save_and_disable_interrupts();
   flash_range_erase(nvs_get_flash_address(), size);
 
   // struct alignment should guarantee flash pages multiples
-  flash_range_program(nvs_get_flash_address(), (uint8_t *)&cec_nvs, sizeof(cec_nvs));
+  flash_range_program(nvs_get_flash_address(), (const uint8_t *)cec_nvs, sizeof(*cec_nvs));
 
   restore_interrupts(irqs);
+  CEC_LOG_DEBUG(CEC_LOG_NVS, "Configuration saved"_CDC_BR);
+}
+
+bool nvs_save_config(const cec_config_t *config) {
+  pico_cec_nvs_t cec_nvs;
+
+  if (sizeof(cec_nvs) > CEC_NVS_LEN) {
+    CEC_LOG_ERROR(CEC_LOG_NVS, "Configuration too large to save"_CDC_BR);
+    return false;
+  }
+
+  nvs_serialise(config, &cec_nvs);
+  nvs_program(&cec_nvs);
 
   return true;
 }
+
+#define NVS_TASK_STACK_SIZE (256)
+
+#define NOTIFY_NVS_SAVE ((UBaseType_t)0)
+
+/* Writes at least this far apart, a calibrating receiver may ask often. */
+#define NVS_SAVE_INTERVAL_MS (30 * 1000)
+
+/* Bus silence needed before the erase, which stalls every interrupt. */
+#define NVS_BUS_QUIET_US (100 * 1000)
+#define NVS_BUS_POLL_MS (20)
+
+static TaskHandle_t xNVSTask;
+
+static const cec_config_t *save_config;
+static nvs_bus_quiet_t save_bus_quiet;
+
+static void nvs_task(void *param) {
+  static cec_config_t snapshot;
+  static pico_cec_nvs_t cec_nvs;
+  TickType_t last = 0;
+  bool saved = false;
+
+  while (true) {
+    ulTaskNotifyTakeIndexed(NOTIFY_NVS_SAVE, pdTRUE, portMAX_DELAY);
+
+    TickType_t elapsed = xTaskGetTickCount() - last;
+    if (saved && (elapsed < pdMS_TO_TICKS(NVS_SAVE_INTERVAL_MS))) {
+      vTaskDelay(pdMS_TO_TICKS(NVS_SAVE_INTERVAL_MS) - elapsed);
+    }
+    while (!save_bus_quiet(NVS_BUS_QUIET_US)) {
+      vTaskDelay(pdMS_TO_TICKS(NVS_BUS_POLL_MS));
+    }
+
+    // requests made since are covered by this write
+    ulTaskNotifyValueClearIndexed(NULL, NOTIFY_NVS_SAVE, UINT32_MAX);
+    // copy under the lock, the serialise and checksum don't need it
+    taskENTER_CRITICAL();
+    snapshot = *save_config;
+    taskEXIT_CRITICAL();
+    nvs_serialise(&snapshot, &cec_nvs);
+    nvs_program(&cec_nvs);
+
+    last = xTaskGetTickCount();
+    saved = true;
+  }
+}
+
+void nvs_task_init(const cec_config_t *config, nvs_bus_quiet_t bus_quiet) {
+  static StaticTask_t nvs_task_static;
+  static StackType_t nvs_stack[NVS_TASK_STACK_SIZE];
+
+  save_config = config;
+  save_bus_quiet = bus_quiet;
+  xNVSTask = xTaskCreateStatic(nvs_task, "nvs", NVS_TASK_STACK_SIZE, NULL, 1, &nvs_stack[0],
+                               &nvs_task_static);
+}
+
+void nvs_request_save(void) {
+  if (xNVSTask != NULL) {
+    xTaskNotifyGiveIndexed(xNVSTask, NOTIFY_NVS_SAVE);
+  }
+}
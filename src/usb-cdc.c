@@ -5,6 +5,7 @@
 #include <tusb.h>
 
 #include "cec-log.h"
+#include "cec-profile.h"
 #include "hdmi-cec.h"
 #include "hdmi-ddc.h"
 #include "nvs.h"
@@ -43,6 +44,7 @@ void usb_device_task(void *param) {
     .speed = TUSB_SPEED_AUTO
   };
   tusb_init(BOARD_TUH_RHPORT, &host_init);
+  cec_profile_usb_init();
 
   if (board_init_after_tusb) {
     board_init_after_tusb();
@@ -112,12 +114,12 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
 
 void tuh_mount_cb(uint8_t dev_addr) {
   // application set-up
-  printf("A device with address %u is mounted\r\n", dev_addr);
+  CEC_LOG_INFO(CEC_LOG_USB, "A device with address %u is mounted\r\n", dev_addr);
 }
 
 void tuh_umount_cb(uint8_t dev_addr) {
   // application tear-down
-  printf("A device with address %u is unmounted \r\n", dev_addr);
+  CEC_LOG_INFO(CEC_LOG_USB, "A device with address %u is unmounted \r\n", dev_addr);
 }
 
 // Invoked when a device with CDC interface is mounted
@@ -126,16 +128,18 @@ void tuh_cdc_mount_cb(uint8_t idx) {
   tuh_itf_info_t itf_info = {0};
   tuh_cdc_itf_get_info(idx, &itf_info);
 
-  printf("CDC Interface is mounted: address = %u, itf_num = %u\r\n", itf_info.daddr,
-         itf_info.desc.bInterfaceNumber);
+  CEC_LOG_INFO(CEC_LOG_USB, "CDC Interface is mounted: address = %u, itf_num = %u\r\n",
+               itf_info.daddr, itf_info.desc.bInterfaceNumber);
 
 #ifdef CFG_TUH_CDC_LINE_CODING_ON_ENUM
   // If CFG_TUH_CDC_LINE_CODING_ON_ENUM is defined, line coding will be set by tinyusb stack
   // while eneumerating new cdc device
   cdc_line_coding_t line_coding = {0};
   if (tuh_cdc_get_local_line_coding(idx, &line_coding)) {
-    printf("  Baudrate: %" PRIu32 ", Stop Bits : %u\r\n", line_coding.bit_rate, line_coding.stop_bits);
-    printf("  Parity  : %u, Data Width: %u\r\n", line_coding.parity, line_coding.data_bits);
+    CEC_LOG_DEBUG(CEC_LOG_USB, "  Baudrate: %" PRIu32 ", Stop Bits : %u\r\n", line_coding.bit_rate,
+                  line_coding.stop_bits);
+    CEC_LOG_DEBUG(CEC_LOG_USB, "  Parity  : %u, Data Width: %u\r\n", line_coding.parity,
+                  line_coding.data_bits);
   }
 #else
   // Set Line Coding upon mounted
@@ -149,6 +153,6 @@ void tuh_cdc_umount_cb(uint8_t idx) {
   tuh_itf_info_t itf_info = {0};
   tuh_cdc_itf_get_info(idx, &itf_info);
 
-  printf("CDC Interface is unmounted: address = %u, itf_num = %u\r\n", itf_info.daddr,
-         itf_info.desc.bInterfaceNumber);
+  CEC_LOG_INFO(CEC_LOG_USB, "CDC Interface is unmounted: address = %u, itf_num = %u\r\n",
+               itf_info.daddr, itf_info.desc.bInterfaceNumber);
 }
\ No newline at end of file
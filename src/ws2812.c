@@ -10,11 +10,12 @@
 #include "ws2812.pio.h"
 
 static semaphore_t mutex;
+static uint ws2812_sm;
 
 void ws2812_put_pixel(uint32_t pixel_grb) {
   // don't block, cannot delay CEC handling
   if (sem_try_acquire(&mutex)) {
-    pio_sm_put_blocking(pio0, 0, pixel_grb << 8u);
+    pio_sm_put_blocking(pio0, ws2812_sm, pixel_grb << 8u);
     sem_release(&mutex);
   }
 }
@@ -26,10 +27,10 @@ void ws2812_put_rgb(uint8_t red, uint8_t green, uint8_t blue) {
 void ws2812_init(unsigned int pin) {
   sem_init(&mutex, 1, 1);
 
-  // Get the default PIO (PIO0) and allocate a state machine (SM0)
+  // Get the default PIO (PIO0) and allocate a state machine, shared with CEC
   PIO pio = pio0;
-  int sm = 0;
+  ws2812_sm = pio_claim_unused_sm(pio, true);
   uint offset = pio_add_program(pio, &ws2812_program);
 
-  ws2812_program_init(pio, sm, offset, pin, 800000, true);
+  ws2812_program_init(pio, ws2812_sm, offset, pin, 800000, true);
 }
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cec_bus.h"
+#include "host.h"
+
+void cec_bus_init(cec_bus_t *bus) {
+  *bus = (cec_bus_t){.scale = 1.0, .seed = 1};
+}
+
+void cec_bus_free(cec_bus_t *bus) {
+  free(bus->edge);
+  cec_bus_init(bus);
+}
+
+void cec_bus_clear(cec_bus_t *bus) {
+  bus->count = 0;
+}
+
+/**
+ * A nominal time in microseconds as this initiator produces it.
+ */
+static uint32_t bus_time(cec_bus_t *bus, uint32_t us) {
+  int32_t time = (int32_t)((us * bus->scale) + 0.5);
+
+  if (bus->jitter > 0) {
+    // a fixed LCG, so every run sees the same timeline
+    bus->seed = (bus->seed * 1103515245u) + 12345u;
+    time += (int32_t)((bus->seed >> 16) % ((2 * bus->jitter) + 1)) - (int32_t)bus->jitter;
+  }
+
+  return (uint32_t)time;
+}
+
+/* Index of the first edge after time. */
+static size_t bus_after(const cec_bus_t *bus, uint64_t time) {
+  size_t lo = 0;
+  size_t hi = bus->count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (bus->edge[mid].time <= time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static void bus_edge(cec_bus_t *bus, uint64_t time, bool level) {
+  if (bus->count == bus->size) {
+    bus->size = (bus->size > 0) ? (bus->size * 2) : 256;
+    bus->edge = realloc(bus->edge, bus->size * sizeof(cec_edge_t));
+    if (bus->edge == NULL) {
+      fprintf(stderr, "cec_bus: out of memory\n");
+      exit(2);
+    }
+  }
+
+  size_t i = bus_after(bus, time);
+  memmove(&bus->edge[i + 1], &bus->edge[i], (bus->count - i) * sizeof(cec_edge_t));
+  bus->edge[i] = (cec_edge_t){.time = time, .level = level};
+  bus->count++;
+}
+
+uint64_t cec_bus_start(cec_bus_t *bus, uint64_t time) {
+  bus_edge(bus, time, false);
+  bus_edge(bus, time + bus_time(bus, CEC_BUS_START_LOW_US), true);
+
+  return time + bus_time(bus, CEC_BUS_START_PERIOD_US);
+}
+
+uint64_t cec_bus_bit(cec_bus_t *bus, uint64_t time, uint32_t low_us) {
+  bus_edge(bus, time, false);
+  bus_edge(bus, time + bus_time(bus, low_us), true);
+
+  return time + bus_time(bus, CEC_BUS_BIT_PERIOD_US);
+}
+
+uint64_t cec_bus_block(cec_bus_t *bus, uint64_t time, uint8_t data, bool eom) {
+  for (int i = 7; i >= 0; i--) {
+    bool bit = (data & (1u << i)) != 0;
+    time = cec_bus_bit(bus, time, bit ? CEC_BUS_ONE_LOW_US : CEC_BUS_ZERO_LOW_US);
+  }
+  time = cec_bus_bit(bus, time, eom ? CEC_BUS_ONE_LOW_US : CEC_BUS_ZERO_LOW_US);
+
+  return cec_bus_bit(bus, time, CEC_BUS_ONE_LOW_US);
+}
+
+uint64_t cec_bus_frame(cec_bus_t *bus, uint64_t time, const uint8_t *data, uint8_t len) {
+  time = cec_bus_start(bus, time);
+  for (uint8_t i = 0; i < len; i++) {
+    time = cec_bus_block(bus, time, data[i], (i + 1) == len);
+  }
+
+  return time;
+}
+
+void cec_bus_pulse(cec_bus_t *bus, uint64_t time, uint32_t width_us, bool level) {
+  bus_edge(bus, time, level);
+  bus_edge(bus, time + width_us, !level);
+}
+
+bool cec_bus_level(const cec_bus_t *bus, uint64_t time) {
+  size_t i = bus_after(bus, time);
+
+  return (i > 0) ? bus->edge[i - 1].level : true;
+}
+
+uint64_t cec_bus_next(const cec_bus_t *bus, uint64_t time, bool level) {
+  if (cec_bus_level(bus, time) == level) {
+    return time;
+  }
+
+  for (size_t i = bus_after(bus, time); i < bus->count; i++) {
+    if (bus->edge[i].level == level) {
+      return bus->edge[i].time;
+    }
+  }
+
+  return UINT64_MAX;
+}
+
+void cec_bus_replay(const cec_bus_t *bus, unsigned int gpio) {
+  for (size_t i = 0; i < bus->count; i++) {
+    host_gpio_drive(gpio, bus->edge[i].time, bus->edge[i].level);
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef CEC_BUS_H
+#define CEC_BUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Nominal bit timing of an initiator, in microseconds. */
+#define CEC_BUS_START_LOW_US (3700)
+#define CEC_BUS_START_PERIOD_US (4500)
+#define CEC_BUS_ONE_LOW_US (600)
+#define CEC_BUS_ZERO_LOW_US (1500)
+#define CEC_BUS_BIT_PERIOD_US (2400)
+
+/* A change in the level an initiator drives. */
+typedef struct {
+  uint64_t time;
+  bool level;
+} cec_edge_t;
+
+/**
+ * Edge timeline of the line as other devices drive it, in time order. The
+ * line is released (high) before the first edge.
+ *
+ * Bits are stretched by scale and each time moved by up to +-jitter, for
+ * initiators off nominal timing.
+ */
+typedef struct {
+  cec_edge_t *edge;
+  size_t count;
+  size_t size;
+  double scale;
+  uint32_t jitter;
+  uint32_t seed;
+} cec_bus_t;
+
+void cec_bus_init(cec_bus_t *bus);
+void cec_bus_free(cec_bus_t *bus);
+
+/** Drop the edges, keeping the timing. */
+void cec_bus_clear(cec_bus_t *bus);
+
+/** Add a start bit at time, returns the start of the first data bit. */
+uint64_t cec_bus_start(cec_bus_t *bus, uint64_t time);
+
+/** Add a bit low for low_us from time, returns the start of the next bit. */
+uint64_t cec_bus_bit(cec_bus_t *bus, uint64_t time, uint32_t low_us);
+
+/**
+ * Add a block: data, EOM, and an ACK bit sent as a 1 for followers to assert.
+ * Returns the start of the next bit.
+ */
+uint64_t cec_bus_block(cec_bus_t *bus, uint64_t time, uint8_t data, bool eom);
+
+/** Add a whole frame, returns the end of its final bit period. */
+uint64_t cec_bus_frame(cec_bus_t *bus, uint64_t time, const uint8_t *data, uint8_t len);
+
+/** Add a pulse to level lasting width_us from time, amid the edges already there. */
+void cec_bus_pulse(cec_bus_t *bus, uint64_t time, uint32_t width_us, bool level);
+
+/** Level driven at time. */
+bool cec_bus_level(const cec_bus_t *bus, uint64_t time);
+
+/** First time from time on that the line is at level, UINT64_MAX if never. */
+uint64_t cec_bus_next(const cec_bus_t *bus, uint64_t time, bool level);
+
+/** Drive the edges on a simulated GPIO, see host.h. */
+void cec_bus_replay(const cec_bus_t *bus, unsigned int gpio);
+
+#endif
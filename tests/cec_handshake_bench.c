@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cec_stub.h"
+#include "check.h"
+#include "host.h"
+
+/* The responder under test, dispatch() does not depend on the PHY. */
+#include "hdmi-cec.c"
+
+/* Our logical and physical address, a playback device on TV input 1. */
+#define BENCH_LADDR (0x04)
+#define BENCH_PADDR (0x1000)
+
+/* Attempts after the first before the TV gives up on a request. */
+#define TV_RETRIES (3)
+
+/* Time the TV waits for an answer, the CEC maximum response time. */
+#define TV_RESPONSE_US (1000000)
+
+/* A frame is a start bit then 10 bit periods per block. */
+#define FRAME_US(blocks) (4500 + ((blocks) * 10 * CEC_BIT_PERIOD_US))
+
+/* A request the TV sends while powering on. */
+typedef struct {
+  uint8_t data[5];
+  uint8_t len;
+  bool wait;       // the TV waits for an answer, and polls again without one
+  uint8_t opcode;  // the answer
+  bool abort_ok;   // a Feature Abort is also an answer
+  bool cec_2_0;    // only sent to CEC 2.0 devices
+} tv_request_t;
+
+/**
+ * The requests of a typical TV power-on, after its own broadcasts. Get Menu
+ * Language is a TV's to answer, so an abort is as good as an answer.
+ */
+static const tv_request_t tv_script[] = {
+    {{0x0f, CEC_ID_REPORT_PHYSICAL_ADDRESS, 0x00, 0x00, 0x00}, 5, false, 0, false, false},
+    {{0x0f, CEC_ID_DEVICE_VENDOR_ID, 0x00, 0x00, 0xf0}, 5, false, 0, false, false},
+    {{BENCH_LADDR, CEC_ID_GIVE_PHYSICAL_ADDRESS}, 2, true, CEC_ID_REPORT_PHYSICAL_ADDRESS, false,
+     false},
+    {{BENCH_LADDR, CEC_ID_GIVE_OSD_NAME}, 2, true, CEC_ID_SET_OSD_NAME, false, false},
+    {{BENCH_LADDR, CEC_ID_GET_CEC_VERSION}, 2, true, CEC_ID_CEC_VERSION, false, false},
+    {{BENCH_LADDR, CEC_ID_GIVE_DEVICE_VENDOR_ID}, 2, true, CEC_ID_DEVICE_VENDOR_ID, false, false},
+    {{BENCH_LADDR, CEC_ID_GIVE_DEVICE_POWER_STATUS}, 2, true, CEC_ID_REPORT_POWER_STATUS, false,
+     false},
+    {{BENCH_LADDR, CEC_ID_GIVE_FEATURES}, 2, true, CEC_ID_REPORT_FEATURES, false, true},
+    {{BENCH_LADDR, CEC_ID_GIVE_DECK_STATUS, 0x03}, 3, true, CEC_ID_DECK_STATUS, false, false},
+    {{BENCH_LADDR, CEC_ID_MENU_REQUEST, 0x02}, 3, true, CEC_ID_MENU_STATUS, false, false},
+    {{BENCH_LADDR, CEC_ID_GET_MENU_LANGUAGE}, 2, true, CEC_ID_SET_MENU_LANGUAGE, true, false},
+    {{0x0f, CEC_ID_REQUEST_ACTIVE_SOURCE}, 2, false, 0, false, false},
+};
+
+/* Traffic of one handshake. */
+typedef struct {
+  unsigned int frames;
+  unsigned int tv_frames;
+  unsigned int polls;
+  uint64_t us;
+} handshake_t;
+
+/* Initiator of the last frame on the bus, for the signal free time. */
+static uint8_t bus_initiator = 0xff;
+
+/**
+ * Add a frame to the handshake, after the signal free time its initiator
+ * waits.
+ */
+static void bus_frame(handshake_t *handshake, const uint8_t *data, uint8_t len) {
+  uint8_t initiator = data[0] >> 4;
+  uint32_t sft = (initiator == bus_initiator) ? SFT_NEXT_FRAME : SFT_NEW_INITIATOR;
+
+  handshake->us += (sft * CEC_BIT_PERIOD_US) + FRAME_US(len);
+  handshake->frames++;
+  bus_initiator = initiator;
+}
+
+/**
+ * Answer a request with Give Deck Status, Menu Request and Give Features
+ * aborted as unrecognised and the CEC version 1.3a. For this script that
+ * puts the same frames on the bus as the responder had before it answered
+ * them.
+ */
+static void dispatch_aborting(const uint8_t *pld, uint8_t pldcnt) {
+  uint8_t initiator = pld[0] >> 4;
+  uint8_t destination = pld[0] & 0x0f;
+
+  switch (pld[1]) {
+    case CEC_ID_GIVE_DECK_STATUS:
+    case CEC_ID_MENU_REQUEST:
+    case CEC_ID_GIVE_FEATURES:
+      cec_feature_abort(destination, initiator, pld[1], CEC_ABORT_UNRECOGNIZED);
+      break;
+    case CEC_ID_GET_CEC_VERSION: {
+      // 0x04 = 1.3a
+      uint8_t version[3] = {HEADER0(destination, initiator), CEC_ID_CEC_VERSION, 0x04};
+      send_reply(3, version);
+    } break;
+    default:
+      dispatch(pld, pldcnt);
+  }
+}
+
+/**
+ * Run the TV's power-on requests against the responder, with our replies
+ * taken from the transmit queues in the order they would be sent.
+ */
+static void handshake_run(bool aborting, handshake_t *handshake) {
+  uint8_t cec_version = 0x00;
+
+  memset(handshake, 0, sizeof(*handshake));
+  bus_initiator = 0xff;
+  for (unsigned int i = 0; i < (sizeof(tv_script) / sizeof(tv_script[0])); i++) {
+    const tv_request_t *request = &tv_script[i];
+
+    if (request->cec_2_0 && (cec_version < 0x05)) {
+      continue;
+    }
+
+    for (unsigned int attempt = 0; attempt <= TV_RETRIES; attempt++) {
+      bool answered = false;
+      bool replied = false;
+
+      if (attempt > 0) {
+        handshake->polls++;
+      }
+      bus_frame(handshake, request->data, request->len);
+      handshake->tv_frames++;
+      if (aborting) {
+        dispatch_aborting(request->data, request->len);
+      } else {
+        dispatch(request->data, request->len);
+      }
+
+      for (unsigned int priority = 0; priority < CEC_TX_PRIORITY_COUNT; priority++) {
+        cec_tx_request_t reply;
+
+        while (xQueueReceive(tx_queue[priority], &reply, 0) == pdTRUE) {
+          cec_tx_request_take(&reply);
+          bus_frame(handshake, reply.data, reply.len);
+          replied = true;
+          if (reply.len < 2) {
+            continue;
+          }
+          if (reply.data[1] == CEC_ID_CEC_VERSION) {
+            cec_version = reply.data[2];
+          }
+          answered |= (reply.data[1] == request->opcode)
+                      || (request->abort_ok && (reply.data[1] == CEC_ID_FEATURE_ABORT));
+        }
+      }
+
+      if (!request->wait || answered) {
+        break;
+      }
+      if (!replied) {
+        handshake->us += TV_RESPONSE_US;
+      }
+    }
+  }
+}
+
+/**
+ * Bus traffic of a TV power-on handshake with a playback device, with the
+ * remaining follower requests aborted and answered.
+ *
+ * The TV polls again, up to TV_RETRIES times, for a request that is not
+ * answered or is refused when it expects an answer. Bus times are nominal
+ * frame times plus signal free times, and time waiting for answers that never
+ * come.
+ */
+int main(int argc, char **argv) {
+  handshake_t aborting;
+  handshake_t answering;
+
+  nvs_load_config(&config);
+  config.device_type = CEC_CONFIG_DEVICE_TYPE_PLAYBACK;
+  laddr = BENCH_LADDR;
+  laddr_mask = 1u << BENCH_LADDR;
+  type_laddr[CEC_CONFIG_DEVICE_TYPE_PLAYBACK] = BENCH_LADDR;
+  paddr = BENCH_PADDR;
+  active_addr = BENCH_PADDR;
+  reply_cache_update();
+  cec_tx_init();
+
+  handshake_run(true, &aborting);
+  handshake_run(false, &answering);
+
+  printf("           frames  tv  polls  bus ms\n");
+  printf("aborting   %6u %3u %6u %7.1f\n", aborting.frames, aborting.tv_frames, aborting.polls,
+         aborting.us / 1000.0);
+  printf("answering  %6u %3u %6u %7.1f\n", answering.frames, answering.tv_frames,
+         answering.polls, answering.us / 1000.0);
+
+  CHECK(answering.polls == 0, "answering: %u requests polled again", answering.polls);
+  CHECK(answering.frames < aborting.frames, "answering: %u frames, aborting %u",
+        answering.frames, aborting.frames);
+  CHECK((reply_cache_queued[0] == 0) && (reply_cache_queued[1] == 0),
+        "reply cache: %u and %u replies still queued", reply_cache_queued[0],
+        reply_cache_queued[1]);
+
+  // a queued reply keeps the body it was queued with across a rebuild
+  static const uint8_t give_osd_name[] = {BENCH_LADDR, CEC_ID_GIVE_OSD_NAME};
+  cec_tx_request_t reply = {0};
+  char name[sizeof(config.osd_name)];
+  memcpy(name, config.osd_name, sizeof(name));
+  dispatch(give_osd_name, sizeof(give_osd_name));
+  strcpy(config.osd_name, "Renamed");
+  reply_cache_update();
+  xQueueReceive(tx_queue[CEC_TX_PRIORITY_REPLY], &reply, 0);
+  cec_tx_request_take(&reply);
+  CHECK((reply.len == (2 + strlen(name))) && (memcmp(&reply.data[2], name, strlen(name)) == 0),
+        "reply cache: OSD name changed while queued");
+
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cec_bus.h"
+#include "check.h"
+#include "host.h"
+
+/* The receiver under test, built with the PIO PHY. */
+#include "hdmi-cec.c"
+
+/* Bus idle between tests. */
+#define TEST_IDLE_US (20000)
+
+/* Signal free time before a new frame from the same initiator. */
+#define TEST_SFT_US (7 * CEC_BUS_BIT_PERIOD_US)
+
+/*
+ * Sample points of the cec_rx program, from the falling edge of a bit. See
+ * hdmi-cec.pio.
+ */
+#define PIO_START_CHECK_US (3400)
+#define PIO_SAMPLE_US (1050)
+#define PIO_BIT_END_US (1950)
+#define PIO_ACK_RELEASE_US (1500)
+
+/* A frame taken from the ring, aborted ones included. */
+typedef struct {
+  hdmi_frame_state_t state;
+  hdmi_frame_abort_t abort;
+  uint8_t len;
+  uint8_t data[16];
+  bool ack;
+} rx_result_t;
+
+static StaticTask_t cec_task_static;
+
+/* Simulated time the next test starts at. */
+static uint64_t test_time = 100000;
+
+/**
+ * Model of the cec_rx program over an edge timeline.
+ *
+ * Follows the program instruction by instruction at its sample points, taking
+ * the ACK decision from the TX FIFO as the program does. Block words are
+ * pushed to the RX FIFO at the time the program pushes them.
+ */
+static void pio_rx_run(const cec_bus_t *bus) {
+  uint64_t t = 0;
+
+  while (true) {
+    uint32_t claim;
+
+    // start: discard a late decision, wait for a start bit
+    while (host_pio_pull(CEC_RX_PIO, cec_rx_sm, &claim)) {
+    }
+    uint64_t fall = cec_bus_next(bus, t, false);
+    if (fall == UINT64_MAX) {
+      return;
+    }
+    t = fall + PIO_START_CHECK_US;
+    if (cec_bus_level(bus, t)) {
+      // released too early, not a start bit
+      continue;
+    }
+
+  resync:
+    t = cec_bus_next(bus, t, true);
+    if (t == UINT64_MAX) {
+      return;
+    }
+    claim = 0;
+    uint32_t isr = 1;  // line released, tags the header block
+
+    while (true) {
+      // 8 data bits and EOM
+      for (unsigned int bit = 0; bit < 9; bit++) {
+        fall = cec_bus_next(bus, t, false);
+        if (fall == UINT64_MAX) {
+          return;
+        }
+        isr = (isr << 1) | (cec_bus_level(bus, fall + PIO_SAMPLE_US) ? 1 : 0);
+        t = fall + PIO_BIT_END_US;
+        if (!cec_bus_level(bus, t)) {
+          // too long for a data bit, treat as a start bit
+          goto resync;
+        }
+      }
+      host_run_until(t);
+      host_pio_push(CEC_RX_PIO, cec_rx_sm, isr);
+      bool eom = (isr & 0x01) != 0;
+
+      // ACK bit, asserted for the frame once the CPU has claimed it
+      fall = cec_bus_next(bus, t, false);
+      if (fall == UINT64_MAX) {
+        return;
+      }
+      uint32_t decision;
+      if (host_pio_pull(CEC_RX_PIO, cec_rx_sm, &decision)) {
+        claim = decision;
+      }
+      bool level = (claim == 0) && cec_bus_level(bus, fall + PIO_SAMPLE_US);
+      t = cec_bus_next(bus, fall + ((claim != 0) ? PIO_ACK_RELEASE_US : 0), true);
+      if (t == UINT64_MAX) {
+        return;
+      }
+      isr = ((level ? 1 : 0) << 1) | 0;  // tags a data block
+
+      if (eom) {
+        host_run_until(t);
+        host_pio_push(CEC_RX_PIO, cec_rx_sm, isr);
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * Bring the receiver up as cec_task does, with the default configuration.
+ */
+static void rx_setup(void) {
+  nvs_load_config(&config);
+  xCECTask = xTaskCreateStatic(cec_task, CEC_TASK_NAME, 0, NULL, 0, NULL, &cec_task_static);
+  host_task_switch(xCECTask);
+
+  gpio_init(CEC_PIN);
+  gpio_set_dir(CEC_PIN, GPIO_IN);
+  hdmi_rx_init();
+}
+
+/**
+ * Run the program model over the timeline, then leave the bus idle.
+ */
+static void rx_replay(cec_bus_t *bus) {
+  pio_rx_run(bus);
+  test_time = bus->edge[bus->count - 1].time + TEST_IDLE_US;
+  host_run_until(test_time);
+  cec_bus_clear(bus);
+}
+
+/**
+ * Take every frame from the ring as recv_frame() does, without skipping the
+ * aborted ones. Returns the number of frames, up to max are copied out.
+ */
+static unsigned int rx_take(rx_result_t *results, unsigned int max) {
+  unsigned int n = 0;
+
+  while (rx_tail != rx_head) {
+    hdmi_rx_slot_t *slot = &rx_ring[rx_tail % RX_RING_SIZE];
+
+    if (n < max) {
+      rx_result_t *result = &results[n];
+      result->state = slot->frame.state;
+      result->abort = slot->frame.abort;
+      result->len = slot->message.len;
+      result->ack = slot->frame.ack;
+      memcpy(result->data, slot->data, sizeof(result->data));
+    }
+    n++;
+    memset(&slot->sums, 0, sizeof(slot->sums));
+    rx_tail++;
+  }
+  ulTaskNotifyTakeIndexed(NOTIFY_RX, pdTRUE, 0);
+
+  return n;
+}
+
+static bool rx_matches(const rx_result_t *result, const uint8_t *data, uint8_t len) {
+  return (result->state == HDMI_FRAME_STATE_END) && (result->abort == HDMI_FRAME_ABORT_NONE)
+         && (result->len == len) && (memcmp(result->data, data, len) == 0);
+}
+
+/**
+ * Block words assemble into the bytes sent, with no ACK from anyone.
+ */
+static void test_decode_frames(void) {
+  static const uint8_t poll[] = {0x40};
+  static const uint8_t standby[] = {0x0f, 0x36};
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  static const uint8_t osd_name[] = {0x40, 0x47, 'a', 'b', 'c', 'd', 'e', 'f',
+                                     'g',  'h',  'i', 'j', 'k', 'l', 'm', 'n'};
+  static const struct {
+    const uint8_t *data;
+    uint8_t len;
+  } frames[] = {
+      {poll, sizeof(poll)},
+      {standby, sizeof(standby)},
+      {key, sizeof(key)},
+      {osd_name, sizeof(osd_name)},
+  };
+  cec_bus_t bus;
+  rx_result_t result;
+
+  cec_bus_init(&bus);
+  for (unsigned int i = 0; i < (sizeof(frames) / sizeof(frames[0])); i++) {
+    cec_bus_frame(&bus, test_time, frames[i].data, frames[i].len);
+    rx_replay(&bus);
+
+    unsigned int n = rx_take(&result, 1);
+    CHECK(n == 1, "decode %u: %u frames received", i, n);
+    CHECK((n == 0) || rx_matches(&result, frames[i].data, frames[i].len),
+          "decode %u: state %u abort %u len %u", i, result.state, result.abort, result.len);
+    CHECK((n == 0) || !result.ack, "decode %u: acked with no follower", i);
+  }
+  cec_bus_free(&bus);
+}
+
+/**
+ * More than 16 blocks abort the frame, and the next frame is still received.
+ */
+static void test_decode_overflow(void) {
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  uint8_t data[17];
+  rx_result_t results[2];
+  cec_bus_t bus;
+
+  memset(data, 0x5a, sizeof(data));
+  data[0] = 0x40;
+  cec_bus_init(&bus);
+  uint64_t end = cec_bus_frame(&bus, test_time, data, sizeof(data));
+  cec_bus_frame(&bus, end + TEST_SFT_US, key, sizeof(key));
+  rx_replay(&bus);
+
+  unsigned int n = rx_take(results, 2);
+  CHECK(n == 2, "overflow: %u frames received", n);
+  CHECK((n < 1)
+            || ((results[0].state == HDMI_FRAME_STATE_ABORT)
+                && (results[0].abort == HDMI_FRAME_ABORT_OVERFLOW) && (results[0].len == 16)),
+        "overflow: state %u abort %u len %u", results[0].state, results[0].abort, results[0].len);
+  CHECK((n < 2) || rx_matches(&results[1], key, sizeof(key)), "overflow: next frame lost");
+  cec_bus_free(&bus);
+}
+
+/**
+ * The CPU claims frames for our addresses from the header word, and the
+ * program then asserts the ACK of every block.
+ */
+static void test_claim(void) {
+  static const uint8_t ours[] = {0x04, 0x44, 0x01};
+  static const uint8_t other[] = {0x06, 0x44, 0x01};
+  static const uint8_t poll[] = {0x44};
+  rx_result_t results[3];
+  cec_bus_t bus;
+
+  laddr_mask = 1u << 4;
+  cec_bus_init(&bus);
+  uint64_t end = cec_bus_frame(&bus, test_time, ours, sizeof(ours));
+  end = cec_bus_frame(&bus, end + TEST_SFT_US, other, sizeof(other));
+  cec_bus_frame(&bus, end + TEST_SFT_US, poll, sizeof(poll));
+  rx_replay(&bus);
+  laddr_mask = 0;
+
+  unsigned int n = rx_take(results, 3);
+  CHECK(n == 3, "claim: %u frames received", n);
+  CHECK((n < 1) || (rx_matches(&results[0], ours, sizeof(ours)) && results[0].ack),
+        "claim: our frame not acked");
+  CHECK((n < 2) || (rx_matches(&results[1], other, sizeof(other)) && !results[1].ack),
+        "claim: another device's frame acked");
+  CHECK((n < 3) || (rx_matches(&results[2], poll, sizeof(poll)) && results[2].ack),
+        "claim: poll of our address not acked");
+  cec_bus_free(&bus);
+}
+
+/**
+ * A start bit in the middle of a frame ends it, and the new frame is received.
+ */
+static void test_resync(void) {
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  rx_result_t results[2];
+  cec_bus_t bus;
+
+  // the initiator gives up after 4 bits of the opcode and starts again
+  cec_bus_init(&bus);
+  uint64_t t = cec_bus_start(&bus, test_time);
+  t = cec_bus_block(&bus, t, key[0], false);
+  for (unsigned int i = 0; i < 4; i++) {
+    t = cec_bus_bit(&bus, t, CEC_BUS_ZERO_LOW_US);
+  }
+  cec_bus_frame(&bus, t, key, sizeof(key));
+  rx_replay(&bus);
+
+  unsigned int n = rx_take(results, 2);
+  CHECK(n == 2, "resync: %u frames received", n);
+  CHECK((n < 1)
+            || ((results[0].state == HDMI_FRAME_STATE_ABORT)
+                && (results[0].abort == HDMI_FRAME_ABORT_RESYNC)),
+        "resync: state %u abort %u", results[0].state, results[0].abort);
+  CHECK((n < 2) || rx_matches(&results[1], key, sizeof(key)), "resync: new frame lost");
+  cec_bus_free(&bus);
+}
+
+int main(int argc, char **argv) {
+  rx_setup();
+
+  test_decode_frames();
+  test_decode_overflow();
+  test_claim();
+  test_resync();
+
+  printf("%u failures\n", failures);
+  return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cec_bus.h"
+#include "cec_stub.h"
+#include "check.h"
+#include "host.h"
+
+/* The receiver under test, built with the GPIO PHY. */
+#include "hdmi-cec.c"
+
+/* Bus idle between tests. */
+#define TEST_IDLE_US (20000)
+
+/* Signal free time before a new frame from the same initiator. */
+#define TEST_SFT_US (7 * CEC_BUS_BIT_PERIOD_US)
+
+/* The shortest signal free time, before a retransmission. */
+#define TEST_MIN_SFT_US (3 * CEC_BUS_BIT_PERIOD_US)
+
+/* A frame taken from the ring, aborted ones included. */
+typedef struct {
+  hdmi_frame_state_t state;
+  hdmi_frame_abort_t abort;
+  uint8_t len;
+  uint8_t data[16];
+  bool ack;
+} rx_result_t;
+
+static StaticTask_t cec_task_static;
+
+/* Simulated time the next test starts at. */
+static uint64_t test_time = 100000;
+
+/**
+ * Bring the receiver up as cec_task does, with the default configuration.
+ */
+static void rx_setup(void) {
+  nvs_load_config(&config);
+  xCECTask = xTaskCreateStatic(cec_task, CEC_TASK_NAME, 0, NULL, 0, NULL, &cec_task_static);
+  host_task_switch(xCECTask);
+
+  gpio_init(CEC_PIN);
+  gpio_set_dir(CEC_PIN, GPIO_IN);
+  hdmi_rx_init();
+}
+
+/**
+ * Drive the timeline on the pin, then leave the bus idle.
+ */
+static void rx_replay(cec_bus_t *bus) {
+  cec_bus_replay(bus, CEC_PIN);
+  test_time = bus->edge[bus->count - 1].time + TEST_IDLE_US;
+  host_run_until(test_time);
+  cec_bus_clear(bus);
+}
+
+/**
+ * Take every frame from the ring as recv_frame() does, without skipping the
+ * aborted ones. Returns the number of frames, up to max are copied out.
+ */
+static unsigned int rx_take(rx_result_t *results, unsigned int max) {
+  unsigned int n = 0;
+
+  while (rx_tail != rx_head) {
+    hdmi_rx_slot_t *slot = &rx_ring[rx_tail % RX_RING_SIZE];
+
+    if (n < max) {
+      rx_result_t *result = &results[n];
+      result->state = slot->frame.state;
+      result->abort = slot->frame.abort;
+      result->len = slot->message.len;
+      result->ack = slot->frame.ack;
+      memcpy(result->data, slot->data, sizeof(result->data));
+    }
+    n++;
+    memset(&slot->sums, 0, sizeof(slot->sums));
+    rx_tail++;
+  }
+  ulTaskNotifyTakeIndexed(NOTIFY_RX, pdTRUE, 0);
+
+  return n;
+}
+
+static bool rx_matches(const rx_result_t *result, const uint8_t *data, uint8_t len) {
+  return (result->state == HDMI_FRAME_STATE_END) && (result->abort == HDMI_FRAME_ABORT_NONE)
+         && (result->len == len) && (memcmp(result->data, data, len) == 0);
+}
+
+/**
+ * Frames of each length decode to the bytes sent, with no ACK from anyone.
+ */
+static void test_decode_frames(void) {
+  static const uint8_t poll[] = {0x40};
+  static const uint8_t standby[] = {0x0f, 0x36};
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  static const uint8_t osd_name[] = {0x40, 0x47, 'a', 'b', 'c', 'd', 'e', 'f',
+                                     'g',  'h',  'i', 'j', 'k', 'l', 'm', 'n'};
+  static const struct {
+    const uint8_t *data;
+    uint8_t len;
+  } frames[] = {
+      {poll, sizeof(poll)},
+      {standby, sizeof(standby)},
+      {key, sizeof(key)},
+      {osd_name, sizeof(osd_name)},
+  };
+  cec_bus_t bus;
+  rx_result_t result;
+
+  cec_bus_init(&bus);
+  for (unsigned int i = 0; i < (sizeof(frames) / sizeof(frames[0])); i++) {
+    cec_bus_frame(&bus, test_time, frames[i].data, frames[i].len);
+    rx_replay(&bus);
+
+    unsigned int n = rx_take(&result, 1);
+    CHECK(n == 1, "decode %u: %u frames received", i, n);
+    CHECK((n == 0) || rx_matches(&result, frames[i].data, frames[i].len),
+          "decode %u: state %u abort %u len %u", i, result.state, result.abort, result.len);
+    CHECK((n == 0) || !result.ack, "decode %u: acked with no follower", i);
+  }
+  cec_bus_free(&bus);
+}
+
+/**
+ * A 17th block aborts the frame, and the next frame is still received.
+ */
+static void test_decode_overflow(void) {
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  uint8_t data[17];
+  rx_result_t results[2];
+  cec_bus_t bus;
+
+  memset(data, 0x5a, sizeof(data));
+  data[0] = 0x40;
+  cec_bus_init(&bus);
+  uint64_t end = cec_bus_frame(&bus, test_time, data, sizeof(data));
+  cec_bus_frame(&bus, end + TEST_SFT_US, key, sizeof(key));
+  rx_replay(&bus);
+
+  unsigned int n = rx_take(results, 2);
+  CHECK(n == 2, "overflow: %u frames received", n);
+  CHECK((n < 1)
+            || ((results[0].state == HDMI_FRAME_STATE_ABORT)
+                && (results[0].abort == HDMI_FRAME_ABORT_OVERFLOW) && (results[0].len == 16)),
+        "overflow: state %u abort %u len %u", results[0].state, results[0].abort, results[0].len);
+  CHECK((n < 2) || rx_matches(&results[1], key, sizeof(key)), "overflow: next frame lost");
+  cec_bus_free(&bus);
+}
+
+/**
+ * Initiators off nominal timing are received up to the edge of the start bit
+ * windows and rejected beyond.
+ */
+static void test_decode_timing(void) {
+  static const struct {
+    double scale;
+    bool received;
+  } timings[] = {
+      {0.97, true},
+      {1.03, true},
+      {0.94, false},
+      {1.06, false},
+  };
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  rx_result_t result;
+  cec_bus_t bus;
+
+  cec_bus_init(&bus);
+  for (unsigned int i = 0; i < (sizeof(timings) / sizeof(timings[0])); i++) {
+    bus.scale = timings[i].scale;
+    cec_bus_frame(&bus, test_time, key, sizeof(key));
+    rx_replay(&bus);
+
+    unsigned int n = rx_take(&result, 1);
+    bool received = (n == 1) && rx_matches(&result, key, sizeof(key));
+    CHECK(received == timings[i].received, "timing x%.2f: %s", timings[i].scale,
+          received ? "received" : "rejected");
+    CHECK(received || (n == 0) || (result.abort == HDMI_FRAME_ABORT_BIT_PERIOD)
+              || (result.abort == HDMI_FRAME_ABORT_START),
+          "timing x%.2f: abort %u", timings[i].scale, result.abort);
+  }
+  cec_bus_free(&bus);
+}
+
+/**
+ * Send frames back to back, each after only the minimum signal free time, and
+ * take them with recv_frame() every batch frames. Returns the number of frames
+ * taken in sequence.
+ */
+static unsigned int rx_stress(unsigned int frames, unsigned int batch) {
+  uint8_t key[] = {0x04, 0x44, 0x00};
+  uint64_t t = test_time;
+  unsigned int taken = 0;
+  cec_bus_t bus;
+
+  cec_bus_init(&bus);
+  for (unsigned int i = 0; i < frames; i++) {
+    key[2] = i & 0xff;
+    t = cec_bus_frame(&bus, t, key, sizeof(key)) + TEST_MIN_SFT_US;
+    cec_bus_replay(&bus, CEC_PIN);
+    cec_bus_clear(&bus);
+
+    if ((((i + 1) % batch) != 0) && ((i + 1) != frames)) {
+      continue;
+    }
+    // the frame just received completes at its final rising edge
+    host_run_until(t);
+    uint32_t notified = host_task_notified(xCECTask, NOTIFY_RX);
+    CHECK(notified == (rx_head - rx_tail), "stress: %u wakeups for %u frames", notified,
+          rx_head - rx_tail);
+
+    hdmi_frame_t *frame;
+    while ((frame = recv_frame(0)) != NULL) {
+      if ((frame->message->len == sizeof(key)) && (frame->message->data[2] == (taken & 0xff))) {
+        taken++;
+      }
+    }
+  }
+  cec_bus_free(&bus);
+
+  test_time = t + TEST_IDLE_US;
+  host_run_until(test_time);
+
+  return taken;
+}
+
+/**
+ * Frames separated by the minimum signal free time are all delivered while
+ * cec_task keeps up, and a task that falls behind only loses the frames that
+ * did not fit in the ring.
+ */
+static void test_back_to_back(void) {
+  uint32_t dropped = cec_stats.rx_dropped_frames;
+  uint32_t received = cec_stats.rx_frames;
+
+  unsigned int taken = rx_stress(256, RX_RING_SIZE);
+  CHECK(taken == 256, "back to back: %u of 256 frames in sequence", taken);
+  CHECK(cec_stats.rx_frames - received == 256, "back to back: %lu frames counted",
+        (unsigned long)(cec_stats.rx_frames - received));
+  CHECK(cec_stats.rx_dropped_frames == dropped, "back to back: %lu frames dropped",
+        (unsigned long)(cec_stats.rx_dropped_frames - dropped));
+
+  // every batch overruns the ring by 2, the ring still recovers
+  dropped = cec_stats.rx_dropped_frames;
+  taken = rx_stress(RX_RING_SIZE + 2, RX_RING_SIZE + 2);
+  CHECK(taken == RX_RING_SIZE, "lagging: %u frames in sequence", taken);
+  CHECK(cec_stats.rx_dropped_frames - dropped == 2, "lagging: %lu frames dropped",
+        (unsigned long)(cec_stats.rx_dropped_frames - dropped));
+  taken = rx_stress(RX_RING_SIZE, RX_RING_SIZE);
+  CHECK(taken == RX_RING_SIZE, "recovered: %u frames in sequence", taken);
+}
+
+/**
+ * Pulses shorter than CEC_RX_GLITCH_US are filtered out, on the idle bus and
+ * in either level of a bit.
+ */
+static void test_glitch(void) {
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  uint32_t glitches = rx_timing_stats.glitches;
+  rx_result_t result;
+  cec_bus_t bus;
+
+  cec_bus_init(&bus);
+  cec_bus_pulse(&bus, test_time, 40, false);
+  uint64_t t = cec_bus_start(&bus, test_time + TEST_SFT_US);
+  // a high spike in the low of the first bit, a zero
+  cec_bus_pulse(&bus, t + 200, 40, true);
+  // a low spike in the high of the next bit, also a zero
+  cec_bus_pulse(&bus, t + CEC_BUS_BIT_PERIOD_US + 1800, 40, false);
+  t = cec_bus_block(&bus, t, key[0], false);
+  t = cec_bus_block(&bus, t, key[1], false);
+  cec_bus_block(&bus, t, key[2], true);
+  rx_replay(&bus);
+
+  unsigned int n = rx_take(&result, 1);
+  CHECK((n == 1) && rx_matches(&result, key, sizeof(key)), "glitch: frame lost, %u received",
+        n);
+  CHECK(rx_timing_stats.glitches - glitches == 3, "glitch: %lu glitches filtered",
+        (unsigned long)(rx_timing_stats.glitches - glitches));
+  cec_bus_free(&bus);
+}
+
+/**
+ * After a corrupt bit the receiver hunts for the next start bit, and a start
+ * bit mid-frame ends the frame and starts the next.
+ */
+static void test_resync(void) {
+  static const uint8_t key[] = {0x04, 0x44, 0x01};
+  uint32_t resyncs = rx_timing_stats.resyncs;
+  rx_result_t results[2];
+  cec_bus_t bus;
+
+  // a bit low for 1 ms is neither a 0 nor a 1, the rest of the frame follows
+  cec_bus_init(&bus);
+  uint64_t t = cec_bus_start(&bus, test_time);
+  t = cec_bus_block(&bus, t, key[0], false);
+  t = cec_bus_bit(&bus, t, 1000);
+  // the other 7 bits, EOM and ACK
+  for (unsigned int i = 0; i < 9; i++) {
+    t = cec_bus_bit(&bus, t, CEC_BUS_ONE_LOW_US);
+  }
+  cec_bus_frame(&bus, t + (SFT_RETRY * CEC_BIT_PERIOD_US), key, sizeof(key));
+  rx_replay(&bus);
+
+  unsigned int n = rx_take(results, 2);
+  CHECK(n == 2, "corrupt bit: %u frames received", n);
+  CHECK((n < 1) || (results[0].abort == HDMI_FRAME_ABORT_BIT_LOW), "corrupt bit: abort %u",
+        results[0].abort);
+  CHECK((n < 2) || rx_matches(&results[1], key, sizeof(key)), "corrupt bit: next frame lost");
+
+  // the initiator starts again 4 bits into the opcode
+  t = cec_bus_start(&bus, test_time);
+  t = cec_bus_block(&bus, t, key[0], false);
+  for (unsigned int i = 0; i < 4; i++) {
+    t = cec_bus_bit(&bus, t, CEC_BUS_ZERO_LOW_US);
+  }
+  cec_bus_frame(&bus, t, key, sizeof(key));
+  rx_replay(&bus);
+
+  n = rx_take(results, 2);
+  CHECK(n == 2, "start mid-frame: %u frames received", n);
+  CHECK((n < 1) || (results[0].abort == HDMI_FRAME_ABORT_RESYNC), "start mid-frame: abort %u",
+        results[0].abort);
+  CHECK((n < 2) || rx_matches(&results[1], key, sizeof(key)), "start mid-frame: frame lost");
+  CHECK(rx_timing_stats.resyncs - resyncs == 1, "start mid-frame: %lu resyncs",
+        (unsigned long)(rx_timing_stats.resyncs - resyncs));
+  cec_bus_free(&bus);
+}
+
+/**
+ * A TV 3.5% slow with jitter shares the bus with a nominal audio system. The
+ * TV runs past the specification's windows, so the relaxed preset is used.
+ * The TV's windows move towards its timing once enough of its frames have been
+ * received, and the shift is saved. The audio system is never affected.
+ */
+static void test_calibration(void) {
+  cec_bus_t tv;
+  cec_bus_t audio;
+  unsigned int saves = nvs_save_requests;
+
+  config.rx_timing_type = CEC_CONFIG_TIMING_RELAXED;
+  cec_config_set_rx_timing(&config);
+  rx_timing_load();
+
+  cec_bus_init(&tv);
+  tv.scale = 1.035;
+  tv.jitter = 80;
+  cec_bus_init(&audio);
+  audio.jitter = 20;
+
+  for (unsigned int round = 0; round < 3; round++) {
+    unsigned int tv_frames = 0;
+    unsigned int audio_frames = 0;
+
+    for (unsigned int i = 0; i < 50; i++) {
+      const uint8_t tv_key[] = {0x04, 0x44, (uint8_t)(0x41 + (i % 4))};
+      const uint8_t audio_status[] = {0x54, 0x7a, (uint8_t)(0x25 + i)};
+
+      uint64_t t = cec_bus_frame(&tv, test_time, tv_key, sizeof(tv_key));
+      cec_bus_replay(&tv, CEC_PIN);
+      cec_bus_clear(&tv);
+      test_time = cec_bus_frame(&audio, t + (SFT_NEW_INITIATOR * CEC_BIT_PERIOD_US),
+                                audio_status, sizeof(audio_status));
+      cec_bus_replay(&audio, CEC_PIN);
+      cec_bus_clear(&audio);
+      test_time += SFT_NEW_INITIATOR * CEC_BIT_PERIOD_US;
+      host_run_until(test_time);
+
+      hdmi_frame_t *frame;
+      while ((frame = recv_frame(0)) != NULL) {
+        if (memcmp(frame->message->data, tv_key, sizeof(tv_key)) == 0) {
+          tv_frames++;
+        } else if (memcmp(frame->message->data, audio_status, sizeof(audio_status)) == 0) {
+          audio_frames++;
+        }
+      }
+    }
+    printf("calibration round %u: tv %u/50, audio system %u/50\n", round, tv_frames,
+           audio_frames);
+    CHECK((round == 0) || (tv_frames == 50), "calibration round %u: tv %u/50", round, tv_frames);
+    CHECK(audio_frames == 50, "calibration round %u: audio system %u/50", round, audio_frames);
+  }
+
+  const cec_config_rx_offset_t *offset = &config.rx_offset[0];
+  CHECK((offset->start_low > 0) && (offset->start_period > 0) && (offset->bit_period > 0),
+        "calibration: tv offsets %d %d %d", offset->start_low, offset->start_period,
+        offset->bit_period);
+  offset = &config.rx_offset[5];
+  CHECK((abs(offset->start_low) < RX_CAL_SAVE_US) && (abs(offset->bit_period) < RX_CAL_SAVE_US),
+        "calibration: audio system offsets %d %d", offset->start_low, offset->bit_period);
+  CHECK(nvs_save_requests > saves, "calibration: shift not saved");
+  CHECK(rx_peer_timing[0].start_low.max <= config.rx_timing.start_low.max,
+        "calibration: tv start bit window ends at %u", rx_peer_timing[0].start_low.max);
+
+  test_time += TEST_IDLE_US;
+  host_run_until(test_time);
+  cec_bus_free(&tv);
+  cec_bus_free(&audio);
+}
+
+/**
+ * Changing the timing preset discards what calibration learnt against the old
+ * windows, the calibrated TV of test_calibration() included.
+ */
+static void test_timing_change(void) {
+  static const cec_config_rx_offset_t none = {0};
+
+  config.rx_timing_type = CEC_CONFIG_TIMING_STRICT;
+  cec_config_set_rx_timing(&config);
+  rx_timing_load();
+
+  CHECK(memcmp(&config.rx_offset[0], &none, sizeof(none)) == 0, "timing change: tv shift kept");
+  CHECK(rx_cal[0].start_low.n == 0, "timing change: %u tv start bits kept", rx_cal[0].start_low.n);
+  CHECK(memcmp(&rx_peer_timing[0], &config.rx_timing, sizeof(config.rx_timing)) == 0,
+        "timing change: tv windows not strict");
+}
+
+/**
+ * A shifted window never reaches past the specification's receiver window,
+ * it only narrows on the other side.
+ */
+static void test_calibration_limits(void) {
+  const cec_config_rx_timing_t *spec = &cec_config_spec_rx_timing;
+
+  config.rx_offset[0].start_low = RX_CAL_MAX_SHIFT_US;
+  config.rx_offset[0].one_low = -RX_CAL_MAX_SHIFT_US;
+  rx_peer_windows(0);
+
+  const cec_config_rx_timing_t *tv = &rx_peer_timing[0];
+  CHECK((tv->start_low.min == (spec->start_low.min + RX_CAL_MAX_SHIFT_US))
+            && (tv->start_low.max == spec->start_low.max),
+        "calibration limits: start bit window %u-%u", tv->start_low.min, tv->start_low.max);
+  CHECK((tv->one_low.min == spec->one_low.min)
+            && (tv->one_low.max == (spec->one_low.max - RX_CAL_MAX_SHIFT_US)),
+        "calibration limits: 1 bit window %u-%u", tv->one_low.min, tv->one_low.max);
+
+  memset(&config.rx_offset[0], 0, sizeof(config.rx_offset[0]));
+  rx_peer_windows(0);
+}
+
+/**
+ * Frames to our addresses are acknowledged, the line is held low until
+ * CEC_RX_ACK_US from the ACK bit falling edge and released by the hardware
+ * alarm. Other devices' frames and our own are left alone.
+ */
+static void test_ack(void) {
+  static const struct {
+    uint8_t data[2];
+    bool loopback;
+    bool ack;
+  } frames[] = {
+      {{0x04, 0x8f}, false, true},
+      {{0x05, 0x8f}, false, true},
+      {{0x06, 0x8f}, false, false},
+      {{0x44, 0x8f}, true, false},
+  };
+  rx_result_t result;
+  cec_bus_t bus;
+
+  laddr_mask = (1u << 4) | (1u << 5);
+  cec_bus_init(&bus);
+  for (unsigned int i = 0; i < (sizeof(frames) / sizeof(frames[0])); i++) {
+    tx_active = frames[i].loopback;
+    uint64_t end = cec_bus_frame(&bus, test_time, frames[i].data, sizeof(frames[i].data));
+    rx_replay(&bus);
+    tx_active = false;
+
+    unsigned int n = rx_take(&result, 1);
+    CHECK((n == 1) && rx_matches(&result, frames[i].data, sizeof(frames[i].data)),
+          "ack %02x: frame lost", frames[i].data[0]);
+    CHECK((n == 0) || (result.ack == frames[i].ack), "ack %02x: acked %u", frames[i].data[0],
+          result.ack);
+
+    // the final ACK bit started one bit period before the end of the frame
+    uint64_t ack_fall = end - CEC_BUS_BIT_PERIOD_US;
+    uint64_t release = host_gpio_last_edge(CEC_PIN, true) - ack_fall;
+    uint64_t expected = frames[i].ack ? CEC_RX_ACK_US : CEC_BUS_ONE_LOW_US;
+    CHECK(release == expected, "ack %02x: released after %lluus, expected %lluus",
+          frames[i].data[0], (unsigned long long)release, (unsigned long long)expected);
+    CHECK(!gpio_is_dir_out(CEC_PIN), "ack %02x: line still driven", frames[i].data[0]);
+  }
+  laddr_mask = 0;
+  cec_bus_free(&bus);
+}
+
+int main(int argc, char **argv) {
+  rx_setup();
+
+  test_decode_frames();
+  test_decode_overflow();
+  test_decode_timing();
+  test_back_to_back();
+  test_glitch();
+  test_resync();
+  test_calibration();
+  test_timing_change();
+  test_calibration_limits();
+  test_ack();
+
+  printf("%u failures\n", failures);
+  return (failures == 0) ? 0 : 1;
+}
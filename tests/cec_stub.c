@@ -0,0 +1,73 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "blink.h"
+#include "cec-capture.h"
+#include "cec-config.h"
+#include "cec-monitor.h"
+#include "cec_stub.h"
+#include "hdmi-ddc.h"
+#include "nvs.h"
+
+/*
+ * The modules hdmi-cec.c calls into, reduced to what the host tests need: no
+ * EDID is ever read, the configuration is the default and nothing is saved.
+ */
+
+unsigned int nvs_save_requests = 0;
+
+volatile bool cec_monitor_active = false;
+volatile bool cec_capture_active = false;
+
+void blink_set(blink_state_t state) {
+}
+
+void blink_set_blink(blink_state_t state) {
+}
+
+void ddc_task_init(uint32_t ready_timeout_ms,
+                   TaskHandle_t hotplug_task,
+                   UBaseType_t hotplug_index) {
+}
+
+bool ddc_take_hotplug(void) {
+  return false;
+}
+
+void ddc_request_physical_address(TaskHandle_t task, UBaseType_t index) {
+}
+
+bool ddc_take_physical_address(uint16_t *address) {
+  return false;
+}
+
+void ddc_refresh(bool full) {
+}
+
+void nvs_load_config(cec_config_t *config) {
+  cec_config_set_default(config);
+  cec_config_set_keymap(config);
+  cec_config_set_rx_timing(config);
+  cec_config_complete(config);
+}
+
+void nvs_task_init(const cec_config_t *config, nvs_bus_quiet_t bus_quiet) {
+}
+
+void nvs_request_save(void) {
+  nvs_save_requests++;
+}
+
+void cec_monitor_capture(uint64_t start,
+                         uint64_t end,
+                         const uint8_t *data,
+                         uint8_t len,
+                         uint8_t flags,
+                         uint8_t abort) {
+}
+
+void cec_capture_edge(uint32_t now, bool level) {
+}
+
+void cec_capture_trigger(uint32_t now) {
+}
@@ -0,0 +1,7 @@
+#ifndef CEC_STUB_H
+#define CEC_STUB_H
+
+/* Saves requested from the NVS task, see cec_stub.c. */
+extern unsigned int nvs_save_requests;
+
+#endif
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "edid.h"
+#include "edid_corpus.h"
+
+#define BENCH_ITERATIONS (100000)
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+/**
+ * Time edid_find_physical_address() over each dump, the reads are memcpy so
+ * this is the parse alone. Host times only rank changes, they are not RP2040
+ * times.
+ */
+int main(int argc, char **argv) {
+  unsigned int iterations = BENCH_ITERATIONS;
+  volatile uint16_t sink = 0;
+
+  if ((argc < 2) || !edid_corpus_load(argv[1])) {
+    printf("usage: %s <corpus dir> [iterations]\n", argv[0]);
+    return 2;
+  }
+  if (argc > 2) {
+    iterations = strtoul(argv[2], NULL, 0);
+  }
+
+  for (unsigned int i = 0; i < edid_corpus_count; i++) {
+    edid_dump_t *dump = &edid_corpus[i];
+    uint64_t start = now_ns();
+
+    for (unsigned int n = 0; n < iterations; n++) {
+      uint16_t address;
+      uint8_t block;
+
+      edid_find_physical_address(edid_corpus_read, dump, &address, &block);
+      sink += address;
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    printf("%-16s %u blocks %8.1f ns/parse\n", dump->name, dump->blocks,
+           (double)elapsed / iterations);
+  }
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "edid_corpus.h"
+
+edid_dump_t edid_corpus[] = {
+    {.name = "tv-cta", .read_ok = true, .address = 0x1000, .block = 1},
+    {.name = "avr-block-map", .read_ok = true, .address = 0x2100, .block = 3},
+    {.name = "displayid", .read_ok = true, .address = 0x3000, .block = 1},
+    {.name = "dvi", .read_ok = true, .address = 0x0000, .block = 0},
+    {.name = "bad-checksum", .read_ok = false},
+    {.name = "bad-header", .read_ok = true, .address = 0x0000, .block = 0},
+    {.name = "truncated", .read_ok = false},
+    {.name = "overrun-db", .read_ok = true, .address = 0x0000, .block = 0},
+    {.name = "short-vsdb", .read_ok = true, .address = 0x0000, .block = 0},
+};
+
+const unsigned int edid_corpus_count = sizeof(edid_corpus) / sizeof(edid_corpus[0]);
+
+/**
+ * Read a dump of whitespace separated hex bytes, '#' starts a comment.
+ */
+static bool load_dump(const char *dir, edid_dump_t *dump) {
+  char path[256];
+  size_t n = 0;
+  int c;
+
+  snprintf(path, sizeof(path), "%s/%s.hex", dir, dump->name);
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+
+  while ((c = fgetc(f)) != EOF) {
+    unsigned int byte;
+
+    if (c == '#') {
+      while (((c = fgetc(f)) != EOF) && (c != '\n')) {
+      }
+      continue;
+    }
+    if ((c == ' ') || (c == '\n') || (c == '\r') || (c == '\t')) {
+      continue;
+    }
+    ungetc(c, f);
+    if ((fscanf(f, "%2x", &byte) != 1) || (n >= sizeof(dump->data))) {
+      fprintf(stderr, "%s: bad byte at offset %zu\n", path, n);
+      fclose(f);
+      return false;
+    }
+    dump->data[n / EDID_BLOCK_SIZE][n % EDID_BLOCK_SIZE] = byte;
+    n++;
+  }
+  fclose(f);
+
+  if ((n == 0) || ((n % EDID_BLOCK_SIZE) != 0)) {
+    fprintf(stderr, "%s: %zu bytes is not a whole number of blocks\n", path, n);
+    return false;
+  }
+  dump->blocks = n / EDID_BLOCK_SIZE;
+
+  return true;
+}
+
+bool edid_corpus_load(const char *dir) {
+  for (unsigned int i = 0; i < edid_corpus_count; i++) {
+    if (!load_dump(dir, &edid_corpus[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int edid_corpus_read(uint8_t block, uint8_t *data, void *ctx) {
+  const edid_dump_t *dump = (const edid_dump_t *)ctx;
+
+  if (block >= dump->blocks) {
+    return -1;
+  }
+  memcpy(data, dump->data[block], EDID_BLOCK_SIZE);
+
+  return edid_block_valid(data) ? 0 : -1;
+}
@@ -0,0 +1,37 @@
+#ifndef EDID_CORPUS_H
+#define EDID_CORPUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "edid.h"
+
+#define EDID_CORPUS_MAX_BLOCKS (8)
+
+/*
+ * An EDID dump as a sink would return it over DDC. The dumps in tests/edid
+ * are synthetic, built by hand to the EDID and CTA-861 layouts rather than
+ * read from real sinks.
+ */
+typedef struct {
+  const char *name;
+  bool read_ok;      // edid_find_physical_address() result
+  uint16_t address;  // expected physical address
+  uint8_t block;     // expected block holding the HDMI VSDB
+  uint8_t blocks;    // blocks loaded from the dump
+  uint8_t data[EDID_CORPUS_MAX_BLOCKS][EDID_BLOCK_SIZE];
+} edid_dump_t;
+
+extern edid_dump_t edid_corpus[];
+extern const unsigned int edid_corpus_count;
+
+/** Load every dump from dir, returns false if one is missing or malformed. */
+bool edid_corpus_load(const char *dir);
+
+/**
+ * Block reader over a dump, fails past the last block and on a bad checksum
+ * like the DDC reader does.
+ */
+int edid_corpus_read(uint8_t block, uint8_t *data, void *ctx);
+
+#endif
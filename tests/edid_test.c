@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "edid.h"
+#include "edid_corpus.h"
+
+/**
+ * Every dump yields the expected physical address and block.
+ */
+static void test_corpus(void) {
+  for (unsigned int i = 0; i < edid_corpus_count; i++) {
+    edid_dump_t *dump = &edid_corpus[i];
+    uint16_t address = 0xffff;
+    uint8_t block = 0xff;
+
+    bool ok = edid_find_physical_address(edid_corpus_read, dump, &address, &block);
+    CHECK(ok == dump->read_ok, "%s: read %s, expected %s", dump->name, ok ? "ok" : "failed",
+          dump->read_ok ? "ok" : "failed");
+    if (ok && dump->read_ok) {
+      CHECK(address == dump->address, "%s: address %04x, expected %04x", dump->name, address,
+            dump->address);
+      CHECK(block == dump->block, "%s: block %u, expected %u", dump->name, block, dump->block);
+    }
+  }
+}
+
+/**
+ * Count the reads made, to check the block map skips unwanted extensions.
+ */
+typedef struct {
+  const edid_dump_t *dump;
+  unsigned int reads;
+} counting_reader_t;
+
+static int counting_read(uint8_t block, uint8_t *data, void *ctx) {
+  counting_reader_t *reader = (counting_reader_t *)ctx;
+
+  reader->reads++;
+  return edid_corpus_read(block, data, (void *)reader->dump);
+}
+
+static const edid_dump_t *find_dump(const char *name) {
+  for (unsigned int i = 0; i < edid_corpus_count; i++) {
+    if (strcmp(edid_corpus[i].name, name) == 0) {
+      return &edid_corpus[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Blocks the map marks as other than CTA or DisplayID are not read.
+ */
+static void test_block_map_skips(void) {
+  edid_dump_t dump = *find_dump("avr-block-map");
+  counting_reader_t reader = {.dump = &dump};
+  uint16_t address;
+  uint8_t block;
+
+  // block 2 becomes a vendor block, the VSDB in block 3 is still found
+  dump.data[1][1] = 0x40;
+  dump.data[1][EDID_CHECKSUM] += 0x02 - 0x40;
+  bool ok = edid_find_physical_address(counting_read, &reader, &address, &block);
+  CHECK(ok && (address == 0x2100) && (block == 3), "block map: address %04x block %u", address,
+        block);
+  CHECK(reader.reads == 3, "block map: %u reads, expected 3", reader.reads);
+}
+
+/**
+ * The iterator stops at a data block running past the collection.
+ */
+static void test_cta_iter_truncated(void) {
+  const uint8_t collection[] = {0x43, 0x01, 0x02, 0x03, 0x65, 0x03, 0x0c};
+  edid_cta_iter_t it;
+  edid_cta_db_t db;
+
+  edid_cta_iter_init_range(&it, collection, sizeof(collection));
+  CHECK(edid_cta_iter_next(&it, &db) && (db.tag == 2) && (db.len == 3), "iter: first block");
+  CHECK(!edid_cta_iter_next(&it, &db), "iter: truncated block returned");
+  CHECK(!edid_cta_iter_next(&it, &db), "iter: iterator did not stay at the end");
+}
+
+int main(int argc, char **argv) {
+  if ((argc < 2) || !edid_corpus_load(argv[1])) {
+    printf("usage: %s <corpus dir>\n", argv[0]);
+    return 2;
+  }
+
+  test_corpus();
+  test_block_map_skips();
+  test_cta_iter_truncated();
+
+  printf("%u dumps, %u failures\n", edid_corpus_count, failures);
+  return (failures == 0) ? 0 : 1;
+}
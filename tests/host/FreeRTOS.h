@@ -0,0 +1,30 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/*
+ * Host stand-in for the FreeRTOS kernel headers, just enough for the firmware
+ * sources under test. There is no scheduler, see host.c.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOSConfig.h"
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000u))
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif
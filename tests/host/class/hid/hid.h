@@ -0,0 +1,33 @@
+#ifndef CLASS_HID_HID_H
+#define CLASS_HID_HID_H
+
+/* HID keyboard usage IDs used by the default keymaps. */
+#define HID_KEY_NONE 0x00
+#define HID_KEY_C 0x06
+#define HID_KEY_F 0x09
+#define HID_KEY_G 0x0A
+#define HID_KEY_I 0x0C
+#define HID_KEY_L 0x0F
+#define HID_KEY_P 0x13
+#define HID_KEY_R 0x15
+#define HID_KEY_X 0x1B
+#define HID_KEY_1 0x1E
+#define HID_KEY_2 0x1F
+#define HID_KEY_3 0x20
+#define HID_KEY_4 0x21
+#define HID_KEY_5 0x22
+#define HID_KEY_6 0x23
+#define HID_KEY_7 0x24
+#define HID_KEY_8 0x25
+#define HID_KEY_9 0x26
+#define HID_KEY_0 0x27
+#define HID_KEY_ENTER 0x28
+#define HID_KEY_BACKSPACE 0x2A
+#define HID_KEY_SPACE 0x2C
+#define HID_KEY_F12 0x45
+#define HID_KEY_ARROW_RIGHT 0x4F
+#define HID_KEY_ARROW_LEFT 0x50
+#define HID_KEY_ARROW_DOWN 0x51
+#define HID_KEY_ARROW_UP 0x52
+
+#endif
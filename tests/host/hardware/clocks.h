@@ -0,0 +1,14 @@
+#ifndef HARDWARE_CLOCKS_H
+#define HARDWARE_CLOCKS_H
+
+#include <stdint.h>
+
+enum clock_index {
+  clk_sys = 5,
+};
+
+static inline uint32_t clock_get_hz(enum clock_index clk_index) {
+  return 125000000;
+}
+
+#endif
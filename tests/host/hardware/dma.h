@@ -0,0 +1,70 @@
+#ifndef HARDWARE_DMA_H
+#define HARDWARE_DMA_H
+
+#include "pico/types.h"
+
+enum dma_channel_transfer_size {
+  DMA_SIZE_8 = 0,
+  DMA_SIZE_16 = 1,
+  DMA_SIZE_32 = 2,
+};
+
+typedef struct {
+  uint32_t ctrl;
+} dma_channel_config;
+
+/* No transfers run on the host, channels are only handed out. */
+int dma_claim_unused_channel(bool required);
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+  return (dma_channel_config){0};
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c,
+                                                         enum dma_channel_transfer_size size) {
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+}
+
+static inline void dma_channel_configure(uint channel,
+                                         const dma_channel_config *config,
+                                         volatile void *write_addr,
+                                         const volatile void *read_addr,
+                                         uint transfer_count,
+                                         bool trigger) {
+}
+
+static inline void dma_channel_set_read_addr(uint channel,
+                                             const volatile void *read_addr,
+                                             bool trigger) {
+}
+
+static inline void dma_channel_set_write_addr(uint channel,
+                                              volatile void *write_addr,
+                                              bool trigger) {
+}
+
+static inline void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+}
+
+static inline void dma_channel_abort(uint channel) {
+}
+
+static inline void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+}
+
+static inline bool dma_channel_get_irq0_status(uint channel) {
+  return false;
+}
+
+static inline void dma_channel_acknowledge_irq0(uint channel) {
+}
+
+#endif
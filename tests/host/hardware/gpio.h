@@ -0,0 +1,26 @@
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+#include "hardware/irq.h"
+#include "pico/types.h"
+
+#define GPIO_IN (false)
+#define GPIO_OUT (true)
+
+#define GPIO_IRQ_LEVEL_LOW (0x1u)
+#define GPIO_IRQ_LEVEL_HIGH (0x2u)
+#define GPIO_IRQ_EDGE_FALL (0x4u)
+#define GPIO_IRQ_EDGE_RISE (0x8u)
+
+void gpio_init(uint gpio);
+void gpio_disable_pulls(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+bool gpio_is_dir_out(uint gpio);
+bool gpio_get(uint gpio);
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled);
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler);
+uint32_t gpio_get_irq_event_mask(uint gpio);
+void gpio_acknowledge_irq(uint gpio, uint32_t events);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HARDWARE_IRQ_H
+#define HARDWARE_IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+
+#define TIMER_IRQ_0 (0)
+#define PIO0_IRQ_0 (7)
+#define PIO1_IRQ_0 (9)
+#define DMA_IRQ_0 (11)
+#define IO_IRQ_BANK0 (13)
+#define USBCTRL_IRQ (5)
+
+#define PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY (0xff)
+#define PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY (0x00)
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef HARDWARE_PIO_H
+#define HARDWARE_PIO_H
+
+#include "hardware/address_mapped.h"
+#include "pico/types.h"
+
+/* Only the FIFO registers, DMA is pointed at them. */
+typedef struct {
+  io_rw_32 txf[4];
+  io_ro_32 rxf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern PIO pio0;
+extern PIO pio1;
+
+typedef struct {
+  const uint16_t *instructions;
+  uint8_t length;
+  int8_t origin;
+} pio_program_t;
+
+typedef struct {
+  uint32_t clkdiv;
+  uint32_t execctrl;
+  uint32_t shiftctrl;
+  uint32_t pinctrl;
+} pio_sm_config;
+
+enum pio_interrupt_source {
+  pis_sm0_rx_fifo_not_empty = 0,
+  pis_interrupt0 = 8,
+};
+
+/* The FIFOs are queues the tests fill and drain, see host.h. */
+uint32_t pio_sm_get(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+
+uint pio_claim_unused_sm(PIO pio, bool required);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+
+/* No state machines run on the host, configuring them does nothing. */
+static inline pio_sm_config pio_get_default_sm_config(void) {
+  return (pio_sm_config){0};
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint base) {
+}
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint base, uint count) {
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint base, uint count) {
+}
+
+static inline void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+}
+
+static inline void sm_config_set_in_shift(pio_sm_config *c,
+                                          bool right,
+                                          bool autopush,
+                                          uint threshold) {
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c,
+                                           bool right,
+                                           bool autopull,
+                                           uint threshold) {
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+}
+
+static inline void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+}
+
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+}
+
+static inline void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t values, uint32_t mask) {
+}
+
+static inline void pio_sm_set_consecutive_pindirs(PIO pio,
+                                                  uint sm,
+                                                  uint base,
+                                                  uint count,
+                                                  bool out) {
+}
+
+static inline void pio_gpio_init(PIO pio, uint pin) {
+}
+
+static inline void pio_set_irq0_source_enabled(PIO pio,
+                                               enum pio_interrupt_source source,
+                                               bool enabled) {
+}
+
+static inline bool pio_interrupt_get(PIO pio, uint num) {
+  return false;
+}
+
+static inline void pio_interrupt_clear(PIO pio, uint num) {
+}
+
+static inline void pio_sm_restart(PIO pio, uint sm) {
+}
+
+static inline uint pio_encode_jmp(uint addr) {
+  return addr;
+}
+
+static inline void pio_sm_exec(PIO pio, uint sm, uint instr) {
+}
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HARDWARE_STRUCTS_SYSTICK_H
+#define HARDWARE_STRUCTS_SYSTICK_H
+
+#include "hardware/address_mapped.h"
+
+typedef struct {
+  io_rw_32 csr;
+  io_rw_32 rvr;
+  io_rw_32 cvr;
+  io_ro_32 calib;
+} systick_hw_t;
+
+/* Stands still on the host, profiled handlers take no cycles. */
+extern systick_hw_t *systick_hw;
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HARDWARE_STRUCTS_TIMER_H
+#define HARDWARE_STRUCTS_TIMER_H
+
+#include "hardware/address_mapped.h"
+
+typedef struct {
+  io_rw_32 timehw;
+  io_rw_32 timelw;
+  io_ro_32 timehr;
+  io_ro_32 timelr;
+  io_rw_32 alarm[4];
+  io_rw_32 armed;
+  io_ro_32 timerawh;
+  io_ro_32 timerawl;
+  io_rw_32 dbgpause;
+  io_rw_32 pause;
+  io_rw_32 intr;
+  io_rw_32 inte;
+  io_rw_32 intf;
+  io_ro_32 ints;
+} timer_hw_t;
+
+/* Writing an alarm register arms it, see host_run_until(). */
+extern timer_hw_t *timer_hw;
+
+#endif
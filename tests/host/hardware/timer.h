@@ -0,0 +1,13 @@
+#ifndef HARDWARE_TIMER_H
+#define HARDWARE_TIMER_H
+
+#include "hardware/structs/timer.h"
+#include "pico/types.h"
+
+/* The host clock, only moved by host_run_until(). */
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+int hardware_alarm_claim_unused(bool required);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HDMI_CEC_PIO_H
+#define HDMI_CEC_PIO_H
+
+/*
+ * Host stand-in for the pioasm output of hdmi-cec.pio. The programs do not run
+ * on the host, the tests model them instead, but the c-sdk helpers are the
+ * real ones: CMake extracts them from hdmi-cec.pio into hdmi-cec.pio.sdk.h.
+ */
+
+#include "hardware/pio.h"
+
+#define cec_rx_TICK_US 50
+#define cec_rx_offset_start 0u
+
+#define cec_tx_TICK_US 50
+#define cec_tx_offset_start 0u
+
+static const pio_program_t cec_rx_program = {0};
+static const pio_program_t cec_tx_program = {0};
+
+static inline pio_sm_config cec_rx_program_get_default_config(uint offset) {
+  return pio_get_default_sm_config();
+}
+
+static inline pio_sm_config cec_tx_program_get_default_config(uint offset) {
+  return pio_get_default_sm_config();
+}
+
+#include "hdmi-cec.pio.sdk.h"
+
+#endif
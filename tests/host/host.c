@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/structs/iobank0.h"
+#include "hardware/structs/systick.h"
+#include "hardware/timer.h"
+#include "host.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "queue.h"
+#include "task.h"
+
+#define HOST_GPIO_COUNT (30)
+#define HOST_IRQ_COUNT (32)
+#define HOST_ALARMS (4)
+#define HOST_ALARM_POOL (8)
+#define HOST_PIO_COUNT (2)
+#define HOST_PIO_SMS (4)
+#define HOST_PIO_FIFO_DEPTH (4)
+
+/* A handler still pending after this many calls never acknowledges its interrupt. */
+#define HOST_IRQ_STUCK (1000)
+
+static uint64_t host_now = 0;
+
+/* Register blocks the firmware writes directly, plain memory on the host. */
+static iobank0_hw_t io_bank0;
+static timer_hw_t timer;
+static systick_hw_t systick = {.rvr = 124999, .cvr = 124999};
+
+iobank0_hw_t *io_bank0_hw = &io_bank0;
+timer_hw_t *timer_hw = &timer;
+systick_hw_t *systick_hw = &systick;
+
+static struct {
+  irq_handler_t handler;
+  bool enabled;
+} irqs[HOST_IRQ_COUNT];
+
+/* Raw GPIO handlers, run from IO_IRQ_BANK0. */
+static irq_handler_t gpio_handlers[HOST_GPIO_COUNT];
+
+static struct {
+  bool drive_low;    // pulled low by the other side
+  bool out;          // pulled low by us, the output latch is always 0
+  bool low;          // the level seen on the pin
+  uint64_t edge[2];  // last falling and rising edge
+} gpios[HOST_GPIO_COUNT];
+
+/* Alarm register values last seen, a new value arms the alarm. */
+static uint32_t alarm_written[HOST_ALARMS];
+static bool alarm_claimed[HOST_ALARMS];
+
+static struct {
+  bool active;
+  uint64_t time;
+  alarm_callback_t callback;
+  void *user_data;
+} alarm_pool[HOST_ALARM_POOL];
+
+typedef struct {
+  uint32_t word[HOST_PIO_FIFO_DEPTH];
+  unsigned int head;
+  unsigned int count;
+} host_fifo_t;
+
+static pio_hw_t pio_blocks[HOST_PIO_COUNT];
+static host_fifo_t pio_rx[HOST_PIO_COUNT][HOST_PIO_SMS];
+static host_fifo_t pio_tx[HOST_PIO_COUNT][HOST_PIO_SMS];
+static uint pio_sms[HOST_PIO_COUNT];
+
+PIO pio0 = &pio_blocks[0];
+PIO pio1 = &pio_blocks[1];
+
+struct host_task {
+  const char *name;
+  uint32_t notify[configTASK_NOTIFICATION_ARRAY_ENTRIES];
+};
+
+struct host_queue {
+  uint8_t *storage;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+_Static_assert(sizeof(struct host_task) <= sizeof(StaticTask_t), "StaticTask_t too small");
+_Static_assert(sizeof(struct host_queue) <= sizeof(StaticQueue_t), "StaticQueue_t too small");
+
+/* The test itself, until it switches to a firmware task. */
+static struct host_task host_main = {.name = "host"};
+static struct host_task *current = &host_main;
+
+/* Set while a handler runs, interrupts raised meanwhile are taken after it. */
+static bool in_irq = false;
+
+/**
+ * Notice alarm registers written by the CPU. Writes that disarm an alarm are
+ * not modelled, the simulated CPU is never late.
+ */
+static void timer_sync(void) {
+  for (unsigned int n = 0; n < HOST_ALARMS; n++) {
+    if (timer.alarm[n] != alarm_written[n]) {
+      alarm_written[n] = timer.alarm[n];
+      timer.armed |= 1u << n;
+    }
+  }
+}
+
+static void irq_run(irq_handler_t handler) {
+  in_irq = true;
+  handler();
+  in_irq = false;
+  timer_sync();
+}
+
+/* Events of a pin enabled on core 0, as gpio_get_irq_event_mask() reads them. */
+static uint32_t gpio_events(uint gpio) {
+  uint32_t shift = 4 * (gpio % 8);
+
+  return ((io_bank0.intr[gpio / 8] & io_bank0.proc0_irq_ctrl.inte[gpio / 8]) >> shift) & 0xf;
+}
+
+static irq_handler_t irq_pending(void) {
+  if (irqs[IO_IRQ_BANK0].enabled) {
+    for (uint gpio = 0; gpio < HOST_GPIO_COUNT; gpio++) {
+      if ((gpio_handlers[gpio] != NULL) && (gpio_events(gpio) != 0)) {
+        return gpio_handlers[gpio];
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < HOST_PIO_COUNT; i++) {
+    uint num = (i == 0) ? PIO0_IRQ_0 : PIO1_IRQ_0;
+    if (!irqs[num].enabled || (irqs[num].handler == NULL)) {
+      continue;
+    }
+    for (uint sm = 0; sm < HOST_PIO_SMS; sm++) {
+      if (pio_rx[i][sm].count > 0) {
+        return irqs[num].handler;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Take pending interrupts until none are left.
+ */
+static void irq_service(void) {
+  irq_handler_t handler;
+  unsigned int calls = 0;
+
+  if (in_irq) {
+    return;
+  }
+
+  while ((handler = irq_pending()) != NULL) {
+    if (++calls > HOST_IRQ_STUCK) {
+      fprintf(stderr, "host: interrupt never acknowledged\n");
+      abort();
+    }
+    irq_run(handler);
+  }
+}
+
+static void gpio_update(uint gpio) {
+  bool low = gpios[gpio].drive_low || gpios[gpio].out;
+
+  if (low == gpios[gpio].low) {
+    return;
+  }
+  gpios[gpio].low = low;
+  gpios[gpio].edge[low ? 0 : 1] = host_now;
+  io_bank0.intr[gpio / 8] |= (low ? GPIO_IRQ_EDGE_FALL : GPIO_IRQ_EDGE_RISE) << (4 * (gpio % 8));
+  irq_service();
+}
+
+/* Time an armed alarm fires, the registers compare the low 32 bits. */
+static uint64_t alarm_due(unsigned int n) {
+  int32_t delta = (int32_t)(timer.alarm[n] - (uint32_t)host_now);
+
+  return host_now + ((delta > 0) ? (uint64_t)delta : 0);
+}
+
+void host_run_until(uint64_t time) {
+  while (true) {
+    uint64_t due = UINT64_MAX;
+    int hw = -1;
+    int pool = -1;
+
+    // the earliest alarm up to time, hardware alarms first on a tie
+    timer_sync();
+    for (unsigned int n = 0; n < HOST_ALARMS; n++) {
+      if ((timer.armed & (1u << n)) && (alarm_due(n) < due)) {
+        due = alarm_due(n);
+        hw = n;
+      }
+    }
+    for (unsigned int i = 0; i < HOST_ALARM_POOL; i++) {
+      if (alarm_pool[i].active && (alarm_pool[i].time < due)) {
+        due = alarm_pool[i].time;
+        hw = -1;
+        pool = i;
+      }
+    }
+    if (due > time) {
+      break;
+    }
+
+    host_now = MAX(host_now, due);
+    if (hw >= 0) {
+      uint num = TIMER_IRQ_0 + hw;
+      timer.armed &= ~(1u << hw);
+      timer.intr |= 1u << hw;
+      if ((timer.inte & (1u << hw)) && irqs[num].enabled && (irqs[num].handler != NULL)) {
+        irq_run(irqs[num].handler);
+      }
+    } else {
+      alarm_pool[pool].active = false;
+      in_irq = true;
+      int64_t next = alarm_pool[pool].callback(pool + 1, alarm_pool[pool].user_data);
+      in_irq = false;
+      timer_sync();
+      if (next != 0) {
+        // positive reschedules from the last alarm time, negative from now
+        alarm_pool[pool].time = (next > 0) ? (alarm_pool[pool].time + next) : (host_now - next);
+        alarm_pool[pool].active = true;
+      }
+    }
+    irq_service();
+  }
+
+  host_now = MAX(host_now, time);
+}
+
+void host_gpio_drive(uint gpio, uint64_t time, bool level) {
+  host_run_until(time);
+  gpios[gpio].drive_low = !level;
+  gpio_update(gpio);
+}
+
+uint64_t host_gpio_last_edge(uint gpio, bool rising) {
+  return gpios[gpio].edge[rising ? 1 : 0];
+}
+
+static unsigned int pio_index(PIO pio) {
+  return (pio == pio1) ? 1 : 0;
+}
+
+static bool fifo_push(host_fifo_t *fifo, uint32_t word) {
+  if (fifo->count >= HOST_PIO_FIFO_DEPTH) {
+    return false;
+  }
+  fifo->word[(fifo->head + fifo->count++) % HOST_PIO_FIFO_DEPTH] = word;
+
+  return true;
+}
+
+static bool fifo_pop(host_fifo_t *fifo, uint32_t *word) {
+  if (fifo->count == 0) {
+    return false;
+  }
+  *word = fifo->word[fifo->head];
+  fifo->head = (fifo->head + 1) % HOST_PIO_FIFO_DEPTH;
+  fifo->count--;
+
+  return true;
+}
+
+bool host_pio_push(PIO pio, uint sm, uint32_t word) {
+  if (!fifo_push(&pio_rx[pio_index(pio)][sm], word)) {
+    return false;
+  }
+  irq_service();
+
+  return true;
+}
+
+bool host_pio_pull(PIO pio, uint sm, uint32_t *word) {
+  return fifo_pop(&pio_tx[pio_index(pio)][sm], word);
+}
+
+void host_task_switch(TaskHandle_t task) {
+  current = (task != NULL) ? task : &host_main;
+}
+
+uint32_t host_task_notified(TaskHandle_t task, UBaseType_t index) {
+  return task->notify[index];
+}
+
+/* pico-sdk */
+
+uint get_core_num(void) {
+  return 0;
+}
+
+uint64_t time_us_64(void) {
+  return host_now;
+}
+
+uint32_t time_us_32(void) {
+  return (uint32_t)host_now;
+}
+
+int hardware_alarm_claim_unused(bool required) {
+  for (unsigned int n = 0; n < HOST_ALARMS; n++) {
+    if (!alarm_claimed[n]) {
+      alarm_claimed[n] = true;
+      return n;
+    }
+  }
+  if (required) {
+    fprintf(stderr, "host: no hardware alarm left\n");
+    abort();
+  }
+
+  return -1;
+}
+
+alarm_id_t add_alarm_at(absolute_time_t time,
+                        alarm_callback_t callback,
+                        void *user_data,
+                        bool fire_if_past) {
+  if ((time <= host_now) && !fire_if_past) {
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < HOST_ALARM_POOL; i++) {
+    if (!alarm_pool[i].active) {
+      alarm_pool[i].active = true;
+      alarm_pool[i].time = MAX(time, host_now);
+      alarm_pool[i].callback = callback;
+      alarm_pool[i].user_data = user_data;
+      return i + 1;
+    }
+  }
+
+  return -1;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us,
+                           alarm_callback_t callback,
+                           void *user_data,
+                           bool fire_if_past) {
+  return add_alarm_at(host_now + us, callback, user_data, fire_if_past);
+}
+
+void gpio_init(uint gpio) {
+}
+
+void gpio_disable_pulls(uint gpio) {
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+  gpios[gpio].out = out;
+  gpio_update(gpio);
+}
+
+bool gpio_is_dir_out(uint gpio) {
+  return gpios[gpio].out;
+}
+
+bool gpio_get(uint gpio) {
+  return !gpios[gpio].low;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t events, bool enabled) {
+  uint32_t mask = events << (4 * (gpio % 8));
+
+  // stale edges are acknowledged first, as the SDK does
+  io_bank0.intr[gpio / 8] &= ~mask;
+  if (enabled) {
+    hw_set_bits(&io_bank0.proc0_irq_ctrl.inte[gpio / 8], mask);
+  } else {
+    hw_clear_bits(&io_bank0.proc0_irq_ctrl.inte[gpio / 8], mask);
+  }
+  irq_service();
+}
+
+void gpio_add_raw_irq_handler(uint gpio, irq_handler_t handler) {
+  gpio_handlers[gpio] = handler;
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+  return gpio_events(gpio);
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t events) {
+  io_bank0.intr[gpio / 8] &= ~(events << (4 * (gpio % 8)));
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  irqs[num].handler = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+  irqs[num].enabled = enabled;
+  irq_service();
+}
+
+int dma_claim_unused_channel(bool required) {
+  static int channels = 0;
+
+  return channels++;
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+  uint32_t word = 0;
+
+  fifo_pop(&pio_rx[pio_index(pio)][sm], &word);
+  return word;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+  // a full FIFO drops the write, as the hardware does
+  fifo_push(&pio_tx[pio_index(pio)][sm], data);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+  return pio_rx[pio_index(pio)][sm].count == 0;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+  memset(&pio_rx[pio_index(pio)][sm], 0, sizeof(host_fifo_t));
+  memset(&pio_tx[pio_index(pio)][sm], 0, sizeof(host_fifo_t));
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm) {
+  return 0;
+}
+
+uint pio_claim_unused_sm(PIO pio, bool required) {
+  return pio_sms[pio_index(pio)]++;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+  return 0;
+}
+
+/* FreeRTOS */
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code,
+                               const char *name,
+                               uint32_t depth,
+                               void *parameters,
+                               UBaseType_t priority,
+                               StackType_t *stack,
+                               StaticTask_t *task) {
+  struct host_task *t = (struct host_task *)task;
+
+  memset(t, 0, sizeof(*t));
+  t->name = name;
+  return t;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return current;
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(host_now / (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskDelay(TickType_t ticks) {
+  host_run_until(host_now + ((uint64_t)ticks * (1000000 / configTICK_RATE_HZ)));
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return 0;
+}
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index) {
+  task->notify[index]++;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveIndexedFromISR(TaskHandle_t task, UBaseType_t index, BaseType_t *woken) {
+  task->notify[index]++;
+  if (woken != NULL) {
+    *woken = pdFALSE;
+  }
+}
+
+uint32_t ulTaskNotifyValueClearIndexed(TaskHandle_t task, UBaseType_t index, uint32_t clear) {
+  struct host_task *t = (task != NULL) ? task : current;
+  uint32_t value = t->notify[index];
+
+  t->notify[index] &= ~clear;
+  return value;
+}
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t timeout) {
+  uint32_t value = current->notify[index];
+
+  if (value > 0) {
+    current->notify[index] = (clear == pdTRUE) ? 0 : (value - 1);
+  }
+  return value;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length,
+                                 UBaseType_t item_size,
+                                 uint8_t *storage,
+                                 StaticQueue_t *queue) {
+  struct host_queue *q = (struct host_queue *)queue;
+
+  *q = (struct host_queue){.storage = storage, .length = length, .item_size = item_size};
+  return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout) {
+  if (queue->count >= queue->length) {
+    return pdFAIL;
+  }
+  memcpy(&queue->storage[((queue->head + queue->count++) % queue->length) * queue->item_size],
+         item, queue->item_size);
+
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+  if (queue->count == 0) {
+    return pdFAIL;
+  }
+  memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return queue->count;
+}
@@ -0,0 +1,43 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/pio.h"
+#include "pico/types.h"
+#include "task.h"
+
+/*
+ * Simulated RP2040 for running firmware sources on the host.
+ *
+ * Time only moves when a test calls host_run_until(). GPIO edge, timer alarm
+ * and PIO FIFO interrupts are taken at the simulated time they happen, each
+ * handler runs to completion before the next.
+ */
+
+/** Move the clock to time, running every alarm that falls due on the way. */
+void host_run_until(uint64_t time);
+
+/**
+ * Set the level another device drives on a pin from time. The pin reads low
+ * while either side pulls it low, as on an open drain bus.
+ */
+void host_gpio_drive(uint gpio, uint64_t time, bool level);
+
+/** Time of the last rising or falling edge seen on a pin. */
+uint64_t host_gpio_last_edge(uint gpio, bool rising);
+
+/** Push a word into a PIO RX FIFO and take the FIFO interrupt, false if full. */
+bool host_pio_push(PIO pio, uint sm, uint32_t word);
+
+/** Take a word the CPU put in a PIO TX FIFO, false if there is none. */
+bool host_pio_pull(PIO pio, uint sm, uint32_t *word);
+
+/** Make task the one calling the task API, e.g. ulTaskNotifyTakeIndexed(). */
+void host_task_switch(TaskHandle_t task);
+
+/** Notifications given to a task and not yet taken. */
+uint32_t host_task_notified(TaskHandle_t task, UBaseType_t index);
+
+#endif
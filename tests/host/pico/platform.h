@@ -0,0 +1,17 @@
+#ifndef PICO_PLATFORM_H
+#define PICO_PLATFORM_H
+
+#include "pico/types.h"
+
+#define __time_critical_func(func) func
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+uint get_core_num(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+#include "hardware/timer.h"
+#include "pico/types.h"
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+  return us;
+}
+
+/* Pool alarms are run from host_run_until(), as the alarm IRQ would. */
+alarm_id_t add_alarm_at(absolute_time_t time,
+                        alarm_callback_t callback,
+                        void *user_data,
+                        bool fire_if_past);
+alarm_id_t add_alarm_in_us(uint64_t us,
+                           alarm_callback_t callback,
+                           void *user_data,
+                           bool fire_if_past);
+
+#endif
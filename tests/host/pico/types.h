@@ -0,0 +1,13 @@
+#ifndef PICO_TYPES_H
+#define PICO_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+/* Microseconds since boot, a plain integer on the host. */
+typedef uint64_t absolute_time_t;
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/* Holds the task's notification state. */
+typedef struct {
+  void *reserved[4];
+} StaticTask_t;
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+/* Tasks are never started, the handle only routes notifications. */
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code,
+                               const char *name,
+                               uint32_t depth,
+                               void *parameters,
+                               UBaseType_t priority,
+                               StackType_t *stack,
+                               StaticTask_t *task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index);
+void vTaskNotifyGiveIndexedFromISR(TaskHandle_t task, UBaseType_t index, BaseType_t *woken);
+uint32_t ulTaskNotifyValueClearIndexed(TaskHandle_t task, UBaseType_t index, uint32_t clear);
+
+/* Never blocks, returns the count given so far. */
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t timeout);
+
+#endif
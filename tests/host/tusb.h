@@ -0,0 +1,12 @@
+#ifndef TUSB_H
+#define TUSB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "class/hid/hid.h"
+
+uint32_t tuh_cdc_write(uint8_t idx, const void *buffer, uint32_t bufsize);
+uint32_t tuh_cdc_write_flush(uint8_t idx);
+
+#endif
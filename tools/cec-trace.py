@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Decode a pico-cec bus monitor trace.
+
+The trace is the byte stream written to the monitor UART by a build with
+CEC_MONITOR=ON, see include/cec-monitor.h for the format. Capture it with any
+serial tool, for example:
+
+    $ stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > bus.trace
+
+then list the frames in the style of `cec-ctl --monitor`:
+
+    $ tools/cec-trace.py bus.trace
+
+or convert them for Wireshark, frames are written as LINKTYPE_USER0 (147)
+packets holding the raw CEC blocks:
+
+    $ tools/cec-trace.py bus.trace --pcap bus.pcap
+
+Edge captures, taken around receive aborts, can be written as a VCD file for
+GTKWave, PulseView and the like:
+
+    $ tools/cec-trace.py bus.trace --vcd edges.vcd
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+SYNC = b"\xce\xc3"
+
+TRACE_HEADER = 0x01
+TRACE_FRAME = 0x02
+TRACE_DROP = 0x03
+TRACE_EDGES = 0x04
+
+FLAG_ACK = 0x01
+FLAG_EOM = 0x02
+FLAG_TX = 0x04
+
+LINKTYPE_USER0 = 147
+
+ABORT = {
+    0: None,
+    1: "start bit",
+    2: "bit period",
+    3: "bit low time",
+    4: "ACK low time",
+    5: "overflow",
+    6: "resync",
+    7: "arbitration lost",
+    8: "bus busy",
+}
+
+DEVICE = [
+    "TV", "Recording Device 1", "Recording Device 2", "Tuner 1",
+    "Playback Device 1", "Audio System", "Tuner 2", "Tuner 3",
+    "Playback Device 2", "Recording Device 3", "Tuner 4", "Playback Device 3",
+    "Backup 1", "Backup 2", "Specific", "all",
+]
+
+OPCODE = {
+    0x00: "FEATURE_ABORT", 0x04: "IMAGE_VIEW_ON", 0x0d: "TEXT_VIEW_ON",
+    0x36: "STANDBY", 0x44: "USER_CONTROL_PRESSED",
+    0x45: "USER_CONTROL_RELEASED", 0x46: "GIVE_OSD_NAME", 0x47: "SET_OSD_NAME",
+    0x70: "SYSTEM_AUDIO_MODE_REQUEST", 0x71: "GIVE_AUDIO_STATUS",
+    0x72: "SET_SYSTEM_AUDIO_MODE", 0x7a: "REPORT_AUDIO_STATUS",
+    0x7d: "GIVE_SYSTEM_AUDIO_MODE_STATUS", 0x7e: "SYSTEM_AUDIO_MODE_STATUS",
+    0x80: "ROUTING_CHANGE", 0x81: "ROUTING_INFORMATION", 0x82: "ACTIVE_SOURCE",
+    0x83: "GIVE_PHYSICAL_ADDR", 0x84: "REPORT_PHYSICAL_ADDR",
+    0x85: "REQUEST_ACTIVE_SOURCE", 0x86: "SET_STREAM_PATH",
+    0x87: "DEVICE_VENDOR_ID", 0x89: "VENDOR_COMMAND", 0x8c: "GIVE_DEVICE_VENDOR_ID",
+    0x8d: "MENU_REQUEST", 0x8e: "MENU_STATUS", 0x8f: "GIVE_DEVICE_POWER_STATUS",
+    0x90: "REPORT_POWER_STATUS", 0x91: "GET_MENU_LANGUAGE",
+    0x32: "SET_MENU_LANGUAGE", 0x9d: "INACTIVE_SOURCE", 0x9e: "CEC_VERSION",
+    0x9f: "GET_CEC_VERSION", 0xa0: "VENDOR_COMMAND_WITH_ID",
+    0xa5: "GIVE_FEATURES", 0xa6: "REPORT_FEATURES",
+    0xc0: "INITIATE_ARC", 0xc3: "REQUEST_ARC_INITIATION", 0xff: "ABORT",
+}
+
+
+def records(data):
+    """Yield (type, payload) for every record with a valid CRC."""
+    i = 0
+    while True:
+        i = data.find(SYNC, i)
+        if i < 0 or i + 4 > len(data):
+            return
+        kind, length = data[i + 2], data[i + 3]
+        end = i + 4 + length + 4
+        if end > len(data):
+            return
+        (crc,) = struct.unpack_from("<I", data, end - 4)
+        if zlib.crc32(data[i + 2:end - 4]) != crc:
+            # not a record boundary, resynchronise on the next sync bytes
+            i += 1
+            continue
+        yield kind, data[i + 4:end - 4]
+        i = end
+
+
+def frames(data):
+    """Yield decoded frames and drop notices."""
+    for kind, payload in records(data):
+        if kind == TRACE_FRAME and len(payload) >= 14:
+            start, duration, flags, abort = struct.unpack_from("<QIBB", payload)
+            yield "frame", (start, duration, flags, abort, payload[14:])
+        elif kind == TRACE_DROP and len(payload) == 4:
+            yield "drop", struct.unpack("<I", payload)[0]
+        elif kind == TRACE_EDGES and len(payload) >= 8:
+            yield "edges", payload
+        elif kind == TRACE_HEADER:
+            yield "header", payload[0] if payload else None
+
+
+def edges(block):
+    """Yield (time, level) for every edge in an edge capture block."""
+    (now,) = struct.unpack_from("<Q", block)
+    value, shift = 0, 0
+    for byte in block[8:]:
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if byte & 0x80:
+            continue
+        now += value >> 1
+        yield now, value & 1
+        value, shift = 0, 0
+
+
+def describe(start, duration, flags, abort, blocks):
+    if not blocks:
+        return "%.6f: aborted at the start bit (%s)" % (start / 1e6, ABORT.get(abort, abort))
+
+    initiator, destination = blocks[0] >> 4, blocks[0] & 0x0f
+    verb = "Transmitted by" if flags & FLAG_TX else "Received from"
+    text = "%.6f: %s %s to %s (%d to %d): " % (
+        start / 1e6, verb, DEVICE[initiator], DEVICE[destination], initiator, destination)
+
+    if len(blocks) == 1:
+        text += "POLL"
+    else:
+        text += "%s (0x%02x)" % (OPCODE.get(blocks[1], "UNKNOWN"), blocks[1])
+        if len(blocks) > 2:
+            text += ": " + " ".join("%02x" % b for b in blocks[2:])
+
+    # a broadcast is accepted when nobody pulls the ACK low
+    acked = bool(flags & FLAG_ACK) != (destination == 0x0f)
+    text += "" if acked else " (nack)"
+    if abort:
+        text += " (aborted: %s)" % ABORT.get(abort, abort)
+    return text
+
+
+def write_pcap(path, items):
+    with open(path, "wb") as out:
+        out.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535, LINKTYPE_USER0))
+        for kind, value in items:
+            if kind != "frame":
+                continue
+            start, _, _, _, blocks = value
+            out.write(struct.pack("<IIII", start // 1000000, start % 1000000, len(blocks),
+                                  len(blocks)))
+            out.write(blocks)
+
+
+def write_vcd(path, items):
+    with open(path, "w") as out:
+        out.write("$timescale 1us $end\n")
+        out.write("$scope module hdmi $end\n$var wire 1 c cec $end\n$upscope $end\n")
+        out.write("$enddefinitions $end\n")
+        last = None
+        for kind, value in items:
+            if kind != "edges":
+                continue
+            for now, level in edges(value):
+                if last is not None and now < last:
+                    # a later capture wrapped the clock, keep the dump monotonic
+                    now = last
+                out.write("#%d\n%dc\n" % (now, level))
+                last = now
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", help="captured trace, - for stdin")
+    parser.add_argument("--pcap", help="write the frames to a pcap file instead")
+    parser.add_argument("--vcd", help="write the edge captures to a VCD file instead")
+    args = parser.parse_args()
+
+    if args.trace == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.trace, "rb") as f:
+            data = f.read()
+
+    items = list(frames(data))
+    if args.pcap:
+        write_pcap(args.pcap, items)
+        return
+    if args.vcd:
+        write_vcd(args.vcd, items)
+        return
+
+    for kind, value in items:
+        if kind == "frame":
+            print(describe(*value))
+        elif kind == "drop":
+            print("%d frames dropped by the monitor" % value)
+        elif kind == "edges":
+            print("edge capture block, %d edges" % len(list(edges(value))))
+        elif kind == "header":
+            print("trace version %s" % value)
+
+
+if __name__ == "__main__":
+    main()